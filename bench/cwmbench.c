@@ -0,0 +1,552 @@
+/*
+ * cwmbench - end-to-end latency benchmark for cwm
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Acts as a set of X clients against a running cwm and times how long
+ * the window manager takes to react.  Each metric is printed as one
+ * tab-separated line:
+ *
+ *	metric	clients	samples	min_us	p50_us	p95_us	max_us
+ *
+ * Key and button input is injected with the XTEST extension, so cwm
+ * must run with its default bindings.
+ *
+ * With -s, only maps and destroys the clients over and over instead,
+ * for bench/soak.sh to check that cwm gives back the memory.  With -c,
+ * also subscribe to events on cwm's control socket first and then stop
+ * reading them, so that cwm's writes to the subscriber fail.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <err.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+
+#define TIMEOUT_MS	5000
+#define MAXSAMPLES	200
+
+struct match {
+	int		 type;
+	Window		 win;
+	Atom		 atom;
+};
+
+static Display		*dpy;
+static Window		 root;
+static Window		*wins;
+static int		 nwins;
+static Atom		 a_active, a_desktop, a_curdesk, a_wmcheck;
+static Atom		 a_clientlist;
+
+static unsigned long long
+now_usec(void)
+{
+	struct timespec	 ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int
+is_ours(Window w)
+{
+	int	 i;
+
+	for (i = 0; i < nwins; i++)
+		if (wins[i] == w)
+			return 1;
+	return 0;
+}
+
+static Bool
+match_pred(Display *d, XEvent *e, XPointer arg)
+{
+	struct match	*m = (struct match *)arg;
+
+	if (e->type != m->type)
+		return False;
+	switch (e->type) {
+	case MapNotify:
+		/* win None means "a window that is not ours", i.e. a menu. */
+		if (m->win == None)
+			return !is_ours(e->xmap.window);
+		return e->xmap.window == m->win;
+	case UnmapNotify:
+		if (m->win == None)
+			return !is_ours(e->xunmap.window);
+		return e->xunmap.window == m->win;
+	case PropertyNotify:
+		return e->xproperty.window == m->win &&
+		    e->xproperty.atom == m->atom;
+	case FocusIn:
+		return e->xfocus.window == m->win;
+	case ConfigureNotify:
+		return e->xconfigure.window == m->win &&
+		    e->xconfigure.event == m->win;
+	}
+	return False;
+}
+
+/* Wait for an event matching m; 0 on success, -1 on timeout. */
+static int
+wait_for(struct match *m)
+{
+	struct pollfd		 pfd;
+	XEvent			 e;
+	unsigned long long	 end = now_usec() + TIMEOUT_MS * 1000ULL;
+	long long		 left;
+
+	pfd.fd = ConnectionNumber(dpy);
+	pfd.events = POLLIN;
+	for (;;) {
+		if (XCheckIfEvent(dpy, &e, match_pred, (XPointer)m))
+			return 0;
+		if ((left = (long long)(end - now_usec())) <= 0)
+			return -1;
+		poll(&pfd, 1, (int)(left / 1000) + 1);
+	}
+}
+
+static void
+drain(void)
+{
+	XEvent	 e;
+
+	XSync(dpy, False);
+	while (XPending(dpy))
+		XNextEvent(dpy, &e);
+}
+
+static int
+cmp_ull(const void *a, const void *b)
+{
+	unsigned long long	 x = *(const unsigned long long *)a;
+	unsigned long long	 y = *(const unsigned long long *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void
+report(const char *metric, unsigned long long *s, int n)
+{
+	if (n == 0) {
+		printf("%s\t%d\t0\t-\t-\t-\t-\n", metric, nwins);
+		return;
+	}
+	qsort(s, n, sizeof(*s), cmp_ull);
+	printf("%s\t%d\t%d\t%llu\t%llu\t%llu\t%llu\n", metric, nwins, n,
+	    s[0], s[n / 2], s[(n * 95) / 100 < n ? (n * 95) / 100 : n - 1],
+	    s[n - 1]);
+	fflush(stdout);
+}
+
+static void
+client_message(Window w, Atom type, long d0)
+{
+	XEvent	 e;
+
+	memset(&e, 0, sizeof(e));
+	e.xclient.type = ClientMessage;
+	e.xclient.window = w;
+	e.xclient.message_type = type;
+	e.xclient.format = 32;
+	e.xclient.data.l[0] = d0;
+	e.xclient.data.l[1] = CurrentTime;
+	XSendEvent(dpy, root, False,
+	    SubstructureRedirectMask | SubstructureNotifyMask, &e);
+	XFlush(dpy);
+}
+
+static void
+wait_for_wm(void)
+{
+	Atom		 type;
+	int		 fmt, i;
+	unsigned long	 n, extra;
+	unsigned char	*p;
+
+	for (i = 0; i < TIMEOUT_MS / 50; i++) {
+		p = NULL;
+		if (XGetWindowProperty(dpy, root, a_wmcheck, 0, 1, False,
+		    XA_WINDOW, &type, &fmt, &n, &extra, &p) == Success &&
+		    n == 1) {
+			XFree(p);
+			return;
+		}
+		if (p != NULL)
+			XFree(p);
+		usleep(50000);
+	}
+	errx(1, "no EWMH window manager on %s", DisplayString(dpy));
+}
+
+static void
+bench_map(void)
+{
+	unsigned long long	 s[MAXSAMPLES], t0;
+	struct match		 m = { MapNotify, None, None };
+	XSetWindowAttributes	 attr;
+	int			 i, n = 0, stride;
+
+	attr.event_mask = StructureNotifyMask | FocusChangeMask |
+	    PropertyChangeMask;
+	stride = (nwins + MAXSAMPLES - 1) / MAXSAMPLES;
+	for (i = 0; i < nwins; i++) {
+		wins[i] = XCreateWindow(dpy, root, 0, 0, 200, 150, 0,
+		    CopyFromParent, InputOutput, CopyFromParent,
+		    CWEventMask, &attr);
+		XStoreName(dpy, wins[i], "cwmbench");
+		m.win = wins[i];
+		t0 = now_usec();
+		XMapWindow(dpy, wins[i]);
+		XFlush(dpy);
+		if (wait_for(&m) == -1)
+			errx(1, "window %d was never mapped", i);
+		if (i % stride == 0 && n < MAXSAMPLES)
+			s[n++] = now_usec() - t0;
+	}
+	report("map_to_managed", s, n);
+}
+
+static void
+bench_focus(void)
+{
+	unsigned long long	 s[MAXSAMPLES], t0;
+	struct match		 m = { FocusIn, None, None };
+	int			 i, n = 0, rounds;
+
+	drain();
+	rounds = nwins < MAXSAMPLES ? nwins : MAXSAMPLES;
+	for (i = 0; i < rounds; i++) {
+		m.win = wins[(i * 7919) % nwins];
+		t0 = now_usec();
+		client_message(m.win, a_active, 2);
+		if (wait_for(&m) == 0)
+			s[n++] = now_usec() - t0;
+	}
+	report("focus_change", s, n);
+}
+
+static void
+bench_group(void)
+{
+	unsigned long long	 s[MAXSAMPLES], t0;
+	struct match		 m = { PropertyNotify, None, None };
+	int			 i, n = 0;
+
+	/* Split the windows over groups one and two. */
+	m.atom = a_desktop;
+	for (i = 0; i < nwins; i++)
+		client_message(wins[i], a_desktop, 1 + (i % 2));
+	for (i = 0; i < nwins; i++) {
+		m.win = wins[i];
+		(void)wait_for(&m);
+	}
+
+	drain();
+	m.win = root;
+	m.atom = a_curdesk;
+	for (i = 0; i < 50; i++) {
+		t0 = now_usec();
+		client_message(root, a_curdesk, 1 + (i % 2));
+		if (wait_for(&m) == 0)
+			s[n++] = now_usec() - t0;
+	}
+	report("group_switch", s, n);
+}
+
+static void
+bench_menu(void)
+{
+	unsigned long long	 s[MAXSAMPLES], t0;
+	struct match		 map = { MapNotify, None, None };
+	struct match		 unmap = { UnmapNotify, None, None };
+	struct match		 desk = { PropertyNotify, None, None };
+	KeyCode			 esc = XKeysymToKeycode(dpy, XK_Escape);
+	int			 i, n = 0;
+
+	/* Show an empty group so the root window is under the pointer. */
+	desk.win = root;
+	desk.atom = a_curdesk;
+	client_message(root, a_curdesk, 3);
+	(void)wait_for(&desk);
+	XTestFakeMotionEvent(dpy, -1, 10, 10, CurrentTime);
+	drain();
+
+	for (i = 0; i < 50; i++) {
+		t0 = now_usec();
+		XTestFakeButtonEvent(dpy, 1, True, CurrentTime);
+		XFlush(dpy);
+		if (wait_for(&map) == 0)
+			s[n++] = now_usec() - t0;
+		XTestFakeKeyEvent(dpy, esc, True, CurrentTime);
+		XTestFakeKeyEvent(dpy, esc, False, CurrentTime);
+		XTestFakeButtonEvent(dpy, 1, False, CurrentTime);
+		XFlush(dpy);
+		(void)wait_for(&unmap);
+	}
+	report("menu_open", s, n);
+}
+
+static void
+bench_drag(void)
+{
+	unsigned long long	 s[MAXSAMPLES], t0;
+	struct match		 m = { ConfigureNotify, None, None };
+	struct match		 f = { FocusIn, None, None };
+	struct match		 desk = { PropertyNotify, None, None };
+	KeyCode			 alt = XKeysymToKeycode(dpy, XK_Alt_L);
+	XWindowAttributes	 wa;
+	Window			 child;
+	int			 i, n = 0, x, y;
+
+	desk.win = root;
+	desk.atom = a_curdesk;
+	client_message(root, a_curdesk, 1);
+	(void)wait_for(&desk);
+
+	m.win = f.win = wins[0];
+	client_message(wins[0], a_active, 2);
+	(void)wait_for(&f);
+	XGetWindowAttributes(dpy, wins[0], &wa);
+	XTranslateCoordinates(dpy, wins[0], root, wa.width / 2,
+	    wa.height / 2, &x, &y, &child);
+	XTestFakeMotionEvent(dpy, -1, x, y, CurrentTime);
+	drain();
+
+	XTestFakeKeyEvent(dpy, alt, True, CurrentTime);
+	XTestFakeButtonEvent(dpy, 1, True, CurrentTime);
+	XFlush(dpy);
+	usleep(100000);
+	drain();
+	for (i = 0; i < 100; i++) {
+		x += (i < 50) ? 4 : -4;
+		y += (i < 50) ? 3 : -3;
+		t0 = now_usec();
+		XTestFakeMotionEvent(dpy, -1, x, y, CurrentTime);
+		XFlush(dpy);
+		if (wait_for(&m) == 0)
+			s[n++] = now_usec() - t0;
+	}
+	XTestFakeButtonEvent(dpy, 1, False, CurrentTime);
+	XTestFakeKeyEvent(dpy, alt, False, CurrentTime);
+	XFlush(dpy);
+	report("drag_frame", s, n);
+}
+
+static int
+client_count(void)
+{
+	Atom		 type;
+	int		 fmt;
+	unsigned long	 n = 0, extra;
+	unsigned char	*p = NULL;
+
+	if (XGetWindowProperty(dpy, root, a_clientlist, 0, 0, False,
+	    XA_WINDOW, &type, &fmt, &n, &extra, &p) != Success)
+		return -1;
+	if (p != NULL)
+		XFree(p);
+	/* Nothing was read, so the whole list is left over. */
+	return (int)(extra / 4);
+}
+
+/* The client list is updated shortly after cwm took or let go a client. */
+static void
+wait_clients(int cycle, int n)
+{
+	int	 i;
+
+	for (i = 0; client_count() != n; i++) {
+		if (i == TIMEOUT_MS / 10)
+			errx(1, "cycle %d: expected %d clients, not %d", cycle,
+			    n, client_count());
+		usleep(10000);
+	}
+}
+
+static void
+soak(int cycles)
+{
+	struct match		 m = { MapNotify, None, None };
+	XSetWindowAttributes	 attr;
+	int			 c, i;
+
+	attr.event_mask = StructureNotifyMask;
+	for (c = 0; c < cycles; c++) {
+		for (i = 0; i < nwins; i++) {
+			wins[i] = XCreateWindow(dpy, root, 0, 0, 200, 150, 0,
+			    CopyFromParent, InputOutput, CopyFromParent,
+			    CWEventMask, &attr);
+			XStoreName(dpy, wins[i], "cwmbench");
+			XMapWindow(dpy, wins[i]);
+		}
+		XFlush(dpy);
+		for (i = 0; i < nwins; i++) {
+			m.win = wins[i];
+			if (wait_for(&m) == -1)
+				errx(1, "cycle %d: window %d was never mapped",
+				    c, i);
+		}
+		wait_clients(c, nwins);
+		for (i = 0; i < nwins; i++)
+			XDestroyWindow(dpy, wins[i]);
+		drain();
+		wait_clients(c, 0);
+	}
+	printf("soak\t%d\t%d\n", nwins, cycles);
+}
+
+/* Subscribe on the control socket, then shut the reading side. */
+static int
+deaf_subscriber(const char *path)
+{
+	struct sockaddr_un	 sun;
+	struct pollfd		 pfd;
+	char			 buf[256];
+	ssize_t			 n;
+	int			 fd, i;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if ((size_t)snprintf(sun.sun_path, sizeof(sun.sun_path), "%s",
+	    path) >= sizeof(sun.sun_path))
+		errx(1, "%s: socket path too long", path);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		err(1, "socket");
+	/* cwm binds the socket only after taking over the display. */
+	for (i = 0; connect(fd, (struct sockaddr *)&sun, sizeof(sun)) == -1;
+	    i++) {
+		if (i == TIMEOUT_MS / 10)
+			err(1, "%s", path);
+		usleep(10000);
+	}
+	if (write(fd, "subscribe\n", 10) != 10)
+		err(1, "%s", path);
+
+	/* Wait for the reply, so cwm has taken the subscription. */
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	do {
+		if (poll(&pfd, 1, TIMEOUT_MS) != 1)
+			errx(1, "%s: no reply to subscribe", path);
+		if ((n = read(fd, buf, sizeof(buf))) <= 0)
+			errx(1, "%s: no reply to subscribe", path);
+	} while (memchr(buf, '\n', n) == NULL);
+
+	if (shutdown(fd, SHUT_RD) == -1)
+		err(1, "shutdown");
+	return fd;
+}
+
+static void
+usage(void)
+{
+	extern char	*__progname;
+
+	(void)fprintf(stderr, "usage: %s [-n clients] [-c socket] [-d display] "
+	    "[-s cycles]\n", __progname);
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char	*display_name = NULL, *sock = NULL;
+	char		*ep;
+	int		 ch, i, evbase, errbase, major, minor, cycles = 0;
+
+	nwins = 10;
+	while ((ch = getopt(argc, argv, "c:d:n:s:")) != -1) {
+		switch (ch) {
+		case 'c':
+			sock = optarg;
+			break;
+		case 'd':
+			display_name = optarg;
+			break;
+		case 'n':
+			nwins = strtol(optarg, &ep, 10);
+			if (*optarg == '\0' || *ep != '\0' ||
+			    nwins < 1 || nwins > 100000)
+				errx(1, "invalid number of clients: %s", optarg);
+			break;
+		case 's':
+			cycles = strtol(optarg, &ep, 10);
+			if (*optarg == '\0' || *ep != '\0' ||
+			    cycles < 1 || cycles > 100000)
+				errx(1, "invalid number of cycles: %s", optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if ((dpy = XOpenDisplay(display_name)) == NULL)
+		errx(1, "unable to open display \"%s\"",
+		    XDisplayName(display_name));
+	if (!XTestQueryExtension(dpy, &evbase, &errbase, &major, &minor))
+		errx(1, "XTEST extension not available");
+	root = DefaultRootWindow(dpy);
+	a_active = XInternAtom(dpy, "_NET_ACTIVE_WINDOW", False);
+	a_desktop = XInternAtom(dpy, "_NET_WM_DESKTOP", False);
+	a_curdesk = XInternAtom(dpy, "_NET_CURRENT_DESKTOP", False);
+	a_wmcheck = XInternAtom(dpy, "_NET_SUPPORTING_WM_CHECK", False);
+	a_clientlist = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
+	wait_for_wm();
+	/* Kept open, unread, until we exit. */
+	if (sock != NULL)
+		(void)deaf_subscriber(sock);
+	XSelectInput(dpy, root, PropertyChangeMask | SubstructureNotifyMask);
+
+	wins = calloc(nwins, sizeof(*wins));
+	if (wins == NULL)
+		err(1, "calloc");
+
+	if (cycles > 0) {
+		soak(cycles);
+		XCloseDisplay(dpy);
+		free(wins);
+		return 0;
+	}
+
+	bench_map();
+	bench_focus();
+	bench_group();
+	bench_menu();
+	bench_drag();
+
+	for (i = 0; i < nwins; i++)
+		XDestroyWindow(dpy, wins[i]);
+	XSync(dpy, False);
+	XCloseDisplay(dpy);
+	free(wins);
+
+	return 0;
+}
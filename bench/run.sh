@@ -0,0 +1,44 @@
+#!/bin/sh
+#
+# Run cwmbench against cwm on a private Xvfb server, once per client
+# count, and print the combined tab-separated results on stdout.
+#
+# usage: run.sh [cwm [cwmbench]]
+# CLIENTS overrides the client counts, e.g. CLIENTS="10 100".
+
+CWM=${1:-./cwm}
+BENCH=${2:-bench/cwmbench}
+CLIENTS=${CLIENTS:-"10 100 1000"}
+
+command -v Xvfb >/dev/null 2>&1 || { echo "bench: Xvfb not found" >&2; exit 1; }
+
+d=99
+while [ -e /tmp/.X11-unix/X$d ] || [ -e /tmp/.X$d-lock ]; do
+	d=$((d + 1))
+done
+
+Xvfb :$d -screen 0 1920x1080x24 -nolisten tcp >/dev/null 2>&1 &
+xpid=$!
+wpid=
+trap 'kill $wpid $xpid 2>/dev/null; wait 2>/dev/null' EXIT INT TERM
+
+i=0
+while [ ! -e /tmp/.X11-unix/X$d ]; do
+	i=$((i + 1))
+	[ $i -gt 100 ] && { echo "bench: Xvfb did not start" >&2; exit 1; }
+	sleep 0.1
+done
+
+export DISPLAY=:$d
+printf 'metric\tclients\tsamples\tmin_us\tp50_us\tp95_us\tmax_us\n'
+status=0
+for n in $CLIENTS; do
+	# A fresh window manager per run keeps the runs independent.
+	"$CWM" -c /dev/null &
+	wpid=$!
+	"$BENCH" -n "$n" || status=1
+	kill $wpid 2>/dev/null
+	wait $wpid 2>/dev/null
+	wpid=
+done
+exit $status
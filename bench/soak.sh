@@ -0,0 +1,72 @@
+#!/bin/sh
+#
+# Cycle clients through cwm on a private Xvfb server and fail if the
+# memory they took is not given back.  cwm runs with allocation
+# accounting (-a); its live bytes per subsystem, as written on SIGUSR1,
+# are compared after a warm-up cycle and after the soak.  The warm-up
+# also runs with a control-socket subscriber that stops reading, which
+# cwm must survive.
+#
+# usage: soak.sh [cwm [cwmbench]]
+# CLIENTS and CYCLES set the clients per cycle and the number of cycles,
+# SLACK the bytes a subsystem may grow by.
+
+CWM=${1:-./cwm}
+BENCH=${2:-bench/cwmbench}
+CLIENTS=${CLIENTS:-100}
+CYCLES=${CYCLES:-50}
+SLACK=${SLACK:-0}
+
+command -v Xvfb >/dev/null 2>&1 || { echo "soak: Xvfb not found" >&2; exit 1; }
+
+d=99
+while [ -e /tmp/.X11-unix/X$d ] || [ -e /tmp/.X$d-lock ]; do
+	d=$((d + 1))
+done
+
+log=$(mktemp) || exit 1
+sock=$log.sock
+Xvfb :$d -screen 0 1920x1080x24 -nolisten tcp >/dev/null 2>&1 &
+xpid=$!
+wpid=
+trap 'kill $wpid $xpid 2>/dev/null; wait 2>/dev/null; rm -f $log $sock' EXIT INT TERM
+
+i=0
+while [ ! -e /tmp/.X11-unix/X$d ]; do
+	i=$((i + 1))
+	[ $i -gt 100 ] && { echo "soak: Xvfb did not start" >&2; exit 1; }
+	sleep 0.1
+done
+
+export DISPLAY=:$d
+"$CWM" -a -c /dev/null -s $sock 2>>$log &
+wpid=$!
+
+# Print the live bytes per subsystem as of the latest counter dump.
+live() {
+	: >$log
+	kill -USR1 $wpid
+	i=0
+	until grep -q '^mem_other_peak:' $log; do
+		i=$((i + 1))
+		[ $i -gt 50 ] && { echo "soak: no counters from cwm" >&2; exit 1; }
+		sleep 0.1
+	done
+	sed -n 's/^mem_\(.*\)_live: /\1 /p' $log
+}
+
+"$BENCH" -n "$CLIENTS" -s 1 -c $sock >/dev/null || exit 1
+kill -0 $wpid 2>/dev/null || { echo "soak: cwm died writing to a gone subscriber" >&2; exit 1; }
+before=$(live) || exit 1
+"$BENCH" -n "$CLIENTS" -s "$CYCLES" >/dev/null || exit 1
+after=$(live) || exit 1
+
+printf 'subsystem\tbefore\tafter\n'
+echo "$before" | while read tag b; do
+	a=$(echo "$after" | sed -n "s/^$tag //p")
+	printf '%s\t%s\t%s\n' "$tag" "$b" "$a"
+	if [ "$a" -gt $((b + SLACK)) ]; then
+		echo "soak: $tag grew by $((a - b)) bytes" >&2
+		exit 1
+	fi
+done
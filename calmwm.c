@@ -24,6 +24,7 @@
 
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <limits.h>
 #include <locale.h>
@@ -42,10 +43,15 @@ Atom			 cwmh[CWMH_NITEMS];
 Atom			 ewmh[EWMH_NITEMS];
 struct screen_q		 Screenq = TAILQ_HEAD_INITIALIZER(Screenq);
 struct conf		 Conf;
+struct stats		 Stats;
 volatile sig_atomic_t	 cwm_status;
+static int		 sigpipe[2];
 
 void	usage(void);
 static void	sighdlr(int);
+static void	crashhdlr(int);
+static void	sig_init(void);
+static void	sig_process(void);
 static int	x_errorhandler(Display *, XErrorEvent *);
 static int	x_init(const char *);
 static void	x_teardown(void);
@@ -54,10 +60,11 @@ static int	x_wmerrorhandler(Display *, XErrorEvent *);
 int
 main(int argc, char **argv)
 {
-	char		*display_name = NULL;
-	char		*fallback;
-	int		 ch, xfd, nflag = 0;
-	struct pollfd	 pfd[1];
+	char		*display_name = NULL, *record = NULL, *replay = NULL;
+	char		*fallback, *sock = NULL, *shmname = NULL;
+	char		*metrics = NULL;
+	int		 ch, xfd, nflag = 0, npfd;
+	struct pollfd	 pfd[2 + CTL_NPOLL];
 
 	if (!setlocale(LC_CTYPE, "") || !XSupportsLocale())
 		warnx("no locale support");
@@ -67,18 +74,36 @@ main(int argc, char **argv)
 
 	fallback = u_argv(argv);
 	Conf.wm_argv = u_argv(argv);
-	while ((ch = getopt(argc, argv, "c:d:nv")) != -1) {
+	while ((ch = getopt(argc, argv, "ac:d:e:m:np:r:s:v")) != -1) {
 		switch (ch) {
+		case 'a':
+			xm_account();
+			break;
 		case 'c':
-			free(Conf.conf_file);
+			xfree(Conf.conf_file);
 			Conf.conf_file = xstrdup(optarg);
 			break;
 		case 'd':
 			display_name = optarg;
 			break;
+		case 'e':
+			metrics = optarg;
+			break;
+		case 'm':
+			shmname = optarg;
+			break;
 		case 'n':
 			nflag = 1;
 			break;
+		case 'p':
+			replay = optarg;
+			break;
+		case 'r':
+			record = optarg;
+			break;
+		case 's':
+			sock = optarg;
+			break;
 		case 'v':
 			Conf.debug++;
 			break;
@@ -89,10 +114,23 @@ main(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
+	log_init();
+	sig_init();
 	if (signal(SIGCHLD, sighdlr) == SIG_ERR ||
 	    signal(SIGHUP, sighdlr) == SIG_ERR ||
 	    signal(SIGINT, sighdlr) == SIG_ERR ||
-	    signal(SIGTERM, sighdlr) == SIG_ERR)
+	    signal(SIGTERM, sighdlr) == SIG_ERR ||
+	    signal(SIGUSR1, sighdlr) == SIG_ERR ||
+	    signal(SIGUSR2, sighdlr) == SIG_ERR)
+		err(1, "signal");
+	/* A control client that went away must not take cwm with it. */
+	if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
+		err(1, "signal");
+	if (signal(SIGSEGV, crashhdlr) == SIG_ERR ||
+	    signal(SIGBUS, crashhdlr) == SIG_ERR ||
+	    signal(SIGFPE, crashhdlr) == SIG_ERR ||
+	    signal(SIGILL, crashhdlr) == SIG_ERR ||
+	    signal(SIGABRT, crashhdlr) == SIG_ERR)
 		err(1, "signal");
 
 	if (parse_config(Conf.conf_file, &Conf) == -1) {
@@ -102,25 +140,55 @@ main(int argc, char **argv)
 	}
 	if (nflag)
 		return 0;
+	conf_rules_compile(&Conf);
 
 	xfd = x_init(display_name);
 	cwm_status = CWM_RUNNING;
 
+	if (replay != NULL) {
+		xev_replay(replay);
+		x_teardown();
+		return 0;
+	}
+	if (record != NULL)
+		xev_record_open(record);
+	if (sock != NULL)
+		ctl_init(sock);
+	if (shmname != NULL)
+		shm_init(shmname);
+	if (metrics != NULL)
+		metrics_init(metrics);
+
 #ifdef __OpenBSD__
-	if (pledge("stdio rpath proc exec", NULL) == -1)
+	/* wpath and cpath for the debug trace ring and the metrics. */
+	if (pledge((sock != NULL || shmname != NULL) ?
+	    "stdio rpath wpath cpath unix proc exec" :
+	    "stdio rpath wpath cpath proc exec", NULL) == -1)
 		err(1, "pledge");
 #endif
 
 	memset(&pfd, 0, sizeof(pfd));
 	pfd[0].fd = xfd;
 	pfd[0].events = POLLIN;
+	pfd[1].fd = sigpipe[0];
+	pfd[1].events = POLLIN;
 	while (cwm_status == CWM_RUNNING) {
 		xev_process();
-		if (poll(pfd, 1, -1) == -1) {
+		npfd = ctl_pollfd(&pfd[2]);
+		if (poll(pfd, 2 + npfd, timer_timeout()) == -1) {
 			if (errno != EINTR)
 				warn("poll");
+			continue;
 		}
+		if (pfd[1].revents & POLLIN)
+			sig_process();
+		ctl_dispatch(&pfd[2], npfd);
+		timer_run();
 	}
+	ctl_close();
+	shm_close();
+	metrics_close();
+	xev_record_close();
 	x_teardown();
 	if (cwm_status == CWM_EXEC_WM) {
 		u_exec(Conf.wm_argv);
@@ -134,17 +202,22 @@ main(int argc, char **argv)
 static int
 x_init(const char *dpyname)
 {
-	int	i;
+	int	i, major, minor;
 
 	if ((X_Dpy = XOpenDisplay(dpyname)) == NULL)
 		errx(1, "unable to open display \"%s\"", XDisplayName(dpyname));
 
 	XSetErrorHandler(x_wmerrorhandler);
 	XSelectInput(X_Dpy, DefaultRootWindow(X_Dpy), SubstructureRedirectMask);
-	XSync(X_Dpy, False);
+	xu_sync(False);
 	XSetErrorHandler(x_errorhandler);
 
 	Conf.xrandr = XRRQueryExtension(X_Dpy, &Conf.xrandr_event_base, &i);
+	if (Conf.xrandr && XRRQueryVersion(X_Dpy, &major, &minor))
+		Conf.xrandr_monitors = (major > 1 || minor >= 5);
+
+	/* Held keys then repeat as presses only, which can be folded. */
+	XkbSetDetectableAutoRepeat(X_Dpy, True, NULL);
 
 	xu_atom_init();
 	conf_cursor(&Conf);
@@ -175,7 +248,7 @@ x_teardown(void)
 	XUngrabKeyboard(X_Dpy, CurrentTime);
 	for (i = 0; i < CF_NITEMS; i++)
 		XFreeCursor(X_Dpy, Conf.cursor[i]);
-	XSync(X_Dpy, False);
+	xu_sync(False);
 	XSetInputFocus(X_Dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
 	XCloseDisplay(X_Dpy);
 }
@@ -203,29 +276,81 @@ x_errorhandler(Display *dpy, XErrorEvent *e)
 	return 0;
 }
 
+/*
+ * Signals only write their number to a pipe, which wakes up the main
+ * loop; sig_process() then handles them there.
+ */
+static void
+sig_init(void)
+{
+	int	 i;
+
+	if (pipe(sigpipe) == -1)
+		err(1, "pipe");
+	for (i = 0; i < 2; i++) {
+		if (fcntl(sigpipe[i], F_SETFL, O_NONBLOCK) == -1 ||
+		    fcntl(sigpipe[i], F_SETFD, FD_CLOEXEC) == -1)
+			err(1, "fcntl");
+	}
+}
+
 static void
 sighdlr(int sig)
 {
-	pid_t	 pid;
-	int	 save_errno = errno, status;
+	unsigned char	 c = sig;
+	int		 save_errno = errno;
+
+	/* A full pipe already has a wakeup pending. */
+	(void)write(sigpipe[1], &c, 1);
+
+	errno = save_errno;
+}
+
+static void
+sig_process(void)
+{
+	unsigned char	 buf[64];
+	ssize_t		 i, n;
+	pid_t		 pid;
+	const char	*path;
+	int		 status, pending[NSIG];
+
+	/* The same signal delivered several times is handled once. */
+	memset(pending, 0, sizeof(pending));
+	while ((n = read(sigpipe[0], buf, sizeof(buf))) > 0) {
+		for (i = 0; i < n; i++) {
+			if (buf[i] < NSIG)
+				pending[buf[i]] = 1;
+		}
+	}
 
-	switch (sig) {
-	case SIGCHLD:
+	if (pending[SIGCHLD]) {
 		/* Collect dead children. */
 		while ((pid = waitpid(-1, &status, WNOHANG)) > 0 ||
 		    (pid < 0 && errno == EINTR))
 			;
-		break;
-	case SIGHUP:
-		cwm_status = CWM_EXEC_WM;
-		break;
-	case SIGINT:
-	case SIGTERM:
+	}
+	if (pending[SIGINT] || pending[SIGTERM])
 		cwm_status = CWM_QUIT;
-		break;
+	if (pending[SIGHUP])
+		conf_reload();
+	if (pending[SIGUSR1])
+		u_stats_dump();
+	if (pending[SIGUSR2]) {
+		if ((path = log_dump()) == NULL)
+			warn("trace");
+		else
+			warnx("trace written to %s", path);
 	}
+}
 
-	errno = save_errno;
+/* Keep the debug trace of a crash, then die of the signal as before. */
+static void
+crashhdlr(int sig)
+{
+	signal(sig, SIG_DFL);
+	(void)log_dump();
+	raise(sig);
 }
 
 void
@@ -233,7 +358,8 @@ usage(void)
 {
 	extern char	*__progname;
 
-	(void)fprintf(stderr, "usage: %s [-nv] [-c file] [-d display]\n",
+	(void)fprintf(stderr, "usage: %s [-anv] [-c file] [-d display] "
+	    "[-e file] [-m name] [-p trace | -r trace] [-s socket]\n",
 	    __progname);
 	exit(1);
 }
@@ -91,6 +91,10 @@ size_t strlcpy(char *, const char *, size_t);
 #define CWM_CYCLE_INGROUP	0x0004
 #define CWM_CYCLE_INCLASS	0x0008
 
+/* Control socket connections, and the poll slots they take. */
+#define CTL_MAXCONN		32
+#define CTL_NPOLL		(CTL_MAXCONN + 1)
+
 enum cwm_status {
 	CWM_QUIT,
 	CWM_RUNNING,
@@ -129,6 +133,13 @@ struct gap {
 	int		 right;
 };
 
+struct timer {
+	unsigned long long	 due;
+	int			 slot; /* heap index + 1, 0 if not armed */
+	void			(*cb)(void *);
+	void			*arg;
+};
+
 struct winname {
 	TAILQ_ENTRY(winname)	 entry;
 	char			*name;
@@ -144,6 +155,8 @@ struct client_ctx {
 	Colormap		 colormap;
 	int			 bwidth; /* border width */
 	int			 obwidth; /* original border width */
+	int			 abwidth; /* border width last applied */
+	unsigned long		 bpixel; /* border pixel last applied */
 	struct geom		 geom, savegeom, fullgeom;
 	struct {
 		long		 flags;	/* defined hints */
@@ -196,6 +209,16 @@ struct client_ctx {
 	char			*res_class; /* class hint */
 	char			*res_name; /* class hint */
 	int			 initial_state; /* wm hint */
+	Atom			*fstate; /* foreign _NET_WM_STATE atoms */
+	int			 nfstate;
+	int			 fstate_pending; /* our own writes in flight */
+	unsigned long		 seq; /* order in which it was managed */
+	int			 shmslot; /* shared state slot + 1, or 0 */
+	struct {
+		unsigned int	 mask; /* pending fields, 0 if none */
+		XWindowChanges	 wc;
+		unsigned long long last; /* usec of last applied request */
+	} cfg;
 };
 TAILQ_HEAD(client_q, client_ctx);
 
@@ -204,9 +227,25 @@ struct group_ctx {
 	struct screen_ctx	*sc;
 	char			*name;
 	int			 num;
+	int			 layout;
+	int			 layout_dirty;
 };
 TAILQ_HEAD(group_q, group_ctx);
 
+enum placement {
+	PLACEMENT_POINTER,
+	PLACEMENT_SMART
+};
+
+enum layout {
+	LAYOUT_FLOAT,
+	LAYOUT_TILE,
+	LAYOUT_GRID,
+	LAYOUT_MONOCLE,
+	LAYOUT_SPIRAL,
+	LAYOUT_NITEMS
+};
+
 struct autogroup {
 	TAILQ_ENTRY(autogroup)	 entry;
 	char			*class;
@@ -215,6 +254,13 @@ struct autogroup {
 };
 TAILQ_HEAD(autogroup_q, autogroup);
 
+struct ignore_node {
+	struct ignore_node	*child;
+	struct ignore_node	*sibling;
+	unsigned char		 ch; /* case-folded */
+	int			 terminal;
+};
+
 struct region_ctx {
 	TAILQ_ENTRY(region_ctx)	 entry;
 	int			 num;
@@ -223,6 +269,9 @@ struct region_ctx {
 };
 TAILQ_HEAD(region_q, region_ctx);
 
+struct snapshot;
+TAILQ_HEAD(snapshot_q, snapshot);
+
 struct screen_ctx {
 	TAILQ_ENTRY(screen_ctx)	 entry;
 	int			 which;
@@ -235,6 +284,8 @@ struct screen_ctx {
 	struct gap		 gap;
 	struct client_q		 clientq;
 	struct region_q		 regionq;
+	char			*outputs; /* connected outputs, sorted */
+	struct snapshot_q	 snapq; /* client geometry per outputs */
 	struct group_q		 groupq;
 	struct group_ctx	*group_active;
 	struct group_ctx	*group_last;
@@ -246,6 +297,8 @@ struct screen_ctx {
 	} prop;
 	XftColor		 xftcolor[CWM_COLOR_NITEMS];
 	XftFont			*xftfont;
+	struct timer		 clientlist; /* deferred _NET_CLIENT_LIST* */
+	struct timer		 randr; /* debounced geometry refresh */
 };
 TAILQ_HEAD(screen_q, screen_ctx);
 
@@ -256,6 +309,8 @@ struct cargs {
 		CWM_XEV_KEY,
 		CWM_XEV_BTN
 	} xev;
+	unsigned int	 keycode; /* key that triggered it, if any */
+	unsigned int	 state;
 };
 enum context {
 	CWM_CONTEXT_NONE = 0,
@@ -309,12 +364,17 @@ struct conf {
 	struct ignore_q		 ignoreq;
 	struct cmd_q		 cmdq;
 	struct wm_q		 wmq;
+	struct autogroup	**agtab; /* compiled autogroupq */
+	unsigned int		 agtabsz;
+	struct ignore_node	*ignoretrie; /* compiled ignoreq */
 	int			 ngroups;
 	int			 stickygroups;
 	int			 nameqlen;
 	int			 bwidth;
 	int			 mamount;
 	int			 snapdist;
+	int			 placement;
+	int			 configurerate;
 	int			 htile;
 	int			 vtile;
 	struct gap		 gap;
@@ -324,12 +384,57 @@ struct conf {
 	Cursor			 cursor[CF_NITEMS];
 	int			 xrandr;
 	int			 xrandr_event_base;
+	int			 xrandr_monitors; /* RandR 1.5 */
 	char			*conf_file;
 	char			*known_hosts;
 	char			*wm_argv;
 	int			 debug;
 };
 
+/* subsystems for the allocation accounting */
+enum xm_tag {
+	XM_OTHER,
+	XM_CLIENT,
+	XM_MENU,
+	XM_SEARCH,
+	XM_CONF,
+	XM_EWMH,
+	XM_NTAGS
+};
+
+/* counters, dumped to stderr on SIGUSR1 */
+struct stats {
+	unsigned long		 group_switch;
+	unsigned long long	 group_switch_usec;
+	unsigned long long	 group_switch_max;
+	unsigned long		 border_requests;
+	unsigned long		 border_skipped;
+	unsigned long		 enter_skipped;
+	unsigned long		 prop_coalesced;
+	unsigned long		 configure_requests;
+	unsigned long		 configure_merged;
+	unsigned long		 configure_deferred;
+	unsigned long		 configure_applied;
+	unsigned long		 ctl_commands;
+	/* Events by type; extension events count as LASTEvent. */
+	unsigned long		 events[LASTEvent + 1];
+	/* Handler latency, bucket i holding up to 4^i usec. */
+#define STATS_NBUCKETS		 10
+	unsigned long		 handler_bucket[STATS_NBUCKETS + 1];
+	unsigned long long	 handler_usec;
+	unsigned long		 xsync;
+	unsigned long		 menu_opens;
+	unsigned long long	 menu_open_usec;
+	unsigned long long	 menu_open_max;
+	unsigned long		 spawns;
+	unsigned long		 allocs;
+	/* Allocated bytes by subsystem, with cwm -a. */
+	struct {
+		unsigned long long	 live;
+		unsigned long long	 peak;
+	} mem[XM_NTAGS];
+};
+
 /* MWM hints */
 struct mwm_hints {
 #define MWM_HINTS_ELEMENTS	5L
@@ -419,6 +524,7 @@ extern Atom				 cwmh[CWMH_NITEMS];
 extern Atom				 ewmh[EWMH_NITEMS];
 extern struct screen_q			 Screenq;
 extern struct conf			 Conf;
+extern struct stats			 Stats;
 
 void			 usage(void);
 
@@ -479,6 +585,33 @@ void			 group_toggle_all(struct screen_ctx *);
 void			 group_toggle_membership(struct client_ctx *);
 void			 group_update_names(struct screen_ctx *);
 
+void			 layout_flush(void);
+void			 layout_mark(struct screen_ctx *, struct group_ctx *);
+void			 layout_mark_all(struct screen_ctx *);
+void			 layout_set(struct screen_ctx *, int);
+
+void			 metrics_close(void);
+void			 metrics_handler(int, unsigned long long);
+void			 metrics_init(const char *);
+
+int			 place_smart(struct client_ctx *, struct geom);
+
+void			 shm_active(Window);
+void			 shm_begin(void);
+void			 shm_client(struct client_ctx *);
+void			 shm_client_remove(struct client_ctx *);
+void			 shm_close(void);
+void			 shm_end(void);
+void			 shm_group(int);
+void			 shm_groups(struct screen_ctx *);
+void			 shm_init(const char *);
+
+void			 timer_add(struct timer *, unsigned long long,
+			     void (*)(void *), void *);
+void			 timer_del(struct timer *);
+void			 timer_run(void);
+int			 timer_timeout(void);
+
 void			 search_match_client(struct menu_q *, struct menu_q *,
 			     char *);
 void			 search_match_cmd(struct menu_q *, struct menu_q *,
@@ -501,6 +634,7 @@ void			 search_print_wm(struct menu *, int);
 
 struct region_ctx	*region_find(struct screen_ctx *, int, int);
 void			 screen_assert_clients_within(struct screen_ctx *);
+void			 screen_randr_defer(struct screen_ctx *);
 struct geom		 screen_area(struct screen_ctx *, int, int, int);
 struct screen_ctx	*screen_find(Window);
 void			 screen_init(int);
@@ -540,6 +674,7 @@ void			 kbfunc_group_last(void *, struct cargs *);
 void			 kbfunc_group_close(void *, struct cargs *);
 void			 kbfunc_group_cycle(void *, struct cargs *);
 void			 kbfunc_group_toggle_all(void *, struct cargs *);
+void			 kbfunc_group_layout(void *, struct cargs *);
 void			 kbfunc_menu_client(void *, struct cargs *);
 void			 kbfunc_menu_cmd(void *, struct cargs *);
 void			 kbfunc_menu_group(void *, struct cargs *);
@@ -547,17 +682,22 @@ void			 kbfunc_menu_wm(void *, struct cargs *);
 void			 kbfunc_menu_exec(void *, struct cargs *);
 void			 kbfunc_menu_ssh(void *, struct cargs *);
 void			 kbfunc_client_menu_label(void *, struct cargs *);
+int			 kbfunc_drag_event(XEvent *);
 void			 kbfunc_exec_cmd(void *, struct cargs *);
 void			 kbfunc_exec_lock(void *, struct cargs *);
 void			 kbfunc_exec_term(void *, struct cargs *);
 
-struct menu  		*menu_filter(struct screen_ctx *, struct menu_q *,
+void			 menu_filter(struct screen_ctx *, struct menu_q *,
 			     const char *, const char *, int,
 			     void (*)(struct menu_q *, struct menu_q *, char *),
-			     void (*)(struct menu *, int));
+			     void (*)(struct menu *, int),
+			     void (*)(struct menu *, void *), void *);
 void			 menuq_add(struct menu_q *, void *, const char *, ...)
 			    __attribute__((__format__ (printf, 3, 4)));
 void			 menuq_clear(struct menu_q *);
+int			 menu_active(void);
+int			 menu_event(XEvent *);
+void			 menu_forget(void *);
 
 int			 parse_config(const char *, struct conf *);
 
@@ -568,12 +708,19 @@ int			 conf_bind_key(struct conf *, const char *,
 int			 conf_bind_mouse(struct conf *, const char *,
     			     const char *);
 void			 conf_clear(struct conf *);
+int			 conf_reload(void);
+void			 conf_rules_compile(struct conf *);
+void			 conf_rules_free(struct conf *);
+int			 conf_autogroup_find(const char *, const char *);
 void			 conf_client(struct client_ctx *);
 void			 conf_cmd_add(struct conf *, const char *,
 			     const char *);
 void			 conf_wm_add(struct conf *, const char *,
 			     const char *);
 void			 conf_cursor(struct conf *);
+int			 conf_func(const char *,
+			     void (**)(void *, struct cargs *),
+			     enum context *, int *);
 void			 conf_grab_kbd(Window);
 void			 conf_grab_mouse(Window);
 void			 conf_init(struct conf *);
@@ -581,11 +728,27 @@ void			 conf_ignore(struct conf *, const char *);
 void			 conf_screen(struct screen_ctx *);
 void			 conf_group(struct screen_ctx *);
 
+struct pollfd;
+void			 ctl_close(void);
+void			 ctl_dispatch(struct pollfd *, int);
+void			 ctl_event(const char *, ...)
+			    __attribute__((__format__ (printf, 1, 2)));
+void			 ctl_init(const char *);
+int			 ctl_pollfd(struct pollfd *);
+
+void			 xev_handle(XEvent *);
+void			 xev_flush(void);
 void			 xev_process(void);
+void			 xev_record(XEvent *);
+void			 xev_record_close(void);
+void			 xev_record_fold(XEvent *);
+void			 xev_record_open(const char *);
+void			 xev_replay(const char *);
 
 int			 xu_get_prop(Window, Atom, Atom, long, unsigned char **);
 int			 xu_get_strprop(Window, Atom, char **);
 void			 xu_ptr_get(Window, int *, int *);
+void			 xu_sync(Bool);
 void			 xu_ptr_set(Window, int, int);
 void			 xu_get_wm_state(Window, long *);
 void			 xu_set_wm_state(Window, long);
@@ -600,6 +763,7 @@ void			 xu_ewmh_net_desktop_viewport(struct screen_ctx *);
 void			 xu_ewmh_net_workarea(struct screen_ctx *);
 void			 xu_ewmh_net_client_list(struct screen_ctx *);
 void			 xu_ewmh_net_client_list_stacking(struct screen_ctx *);
+void			 xu_ewmh_net_client_lists_defer(struct screen_ctx *);
 void			 xu_ewmh_net_active_window(struct screen_ctx *, Window);
 void			 xu_ewmh_net_number_of_desktops(struct screen_ctx *);
 void			 xu_ewmh_net_showing_desktop(struct screen_ctx *);
@@ -613,22 +777,42 @@ void 			 xu_ewmh_handle_net_wm_state_msg(struct client_ctx *,
 			     int, Atom, Atom);
 void 			 xu_ewmh_set_net_wm_state(struct client_ctx *);
 void 			 xu_ewmh_restore_net_wm_state(struct client_ctx *);
+void			 xu_ewmh_update_net_wm_state(struct client_ctx *);
 
 char			*u_argv(char * const *);
+void			 u_stats_dump(void);
+unsigned long long	 u_time_usec(void);
 void			 u_exec(char *);
 void			 u_spawn(char *);
+const char		*log_dump(void);
+void			 log_init(void);
 void			 log_debug(int, const char *, const char *, ...)
 			    __attribute__((__format__ (printf, 3, 4)))
 			    __attribute__((__nonnull__ (3)));
 
-void			*xcalloc(size_t, size_t);
-void			*xmalloc(size_t);
-void			*xreallocarray(void *, size_t, size_t);
-char			*xstrdup(const char *);
-int			 xasprintf(char **, const char *, ...)
-			    __attribute__((__format__ (printf, 2, 3)))
-			    __attribute__((__nonnull__ (2)));
-int			 xvasprintf(char **, const char *, va_list)
-			    __attribute__((__nonnull__ (2)));
+/*
+ * The allocation wrappers take the file they are called from, which
+ * xmalloc.c maps to a subsystem tag when accounting is on.
+ */
+#define xcalloc(n, s)		xm_calloc(__FILE__, (n), (s))
+#define xmalloc(s)		xm_malloc(__FILE__, (s))
+#define xreallocarray(p, n, s)	xm_reallocarray(__FILE__, (p), (n), (s))
+#define xstrdup(s)		xm_strdup(__FILE__, (s))
+#define xasprintf(r, ...)	xm_asprintf(__FILE__, (r), __VA_ARGS__)
+#define xvasprintf(r, f, a)	xm_vasprintf(__FILE__, (r), (f), (a))
+
+void			 xm_account(void);
+const char		*xm_tag_name(int);
+void			*xm_calloc(const char *, size_t, size_t);
+void			*xm_malloc(const char *, size_t);
+void			*xm_reallocarray(const char *, void *, size_t, size_t);
+char			*xm_strdup(const char *, const char *);
+int			 xm_asprintf(const char *, char **, const char *, ...)
+			    __attribute__((__format__ (printf, 3, 4)))
+			    __attribute__((__nonnull__ (3)));
+int			 xm_vasprintf(const char *, char **, const char *,
+			    va_list)
+			    __attribute__((__nonnull__ (3)));
+void			 xfree(void *);
 
 #endif /* _CALMWM_H_ */
@@ -39,6 +39,7 @@ static void			 client_wm_protocols(struct client_ctx *);
 struct client_ctx *
 client_init(Window win, struct screen_ctx *sc)
 {
+	static unsigned long	 seq;
 	struct client_ctx	*cc;
 	XWindowAttributes	 wattr;
 	int			 mapped;
@@ -72,6 +73,12 @@ client_init(Window win, struct screen_ctx *sc)
 	cc->flags = 0;
 	cc->stackingorder = 0;
 	cc->initial_state = 0;
+	cc->fstate = NULL;
+	cc->nfstate = 0;
+	cc->fstate_pending = 0;
+	cc->seq = seq++;
+	cc->shmslot = 0;
+	memset(&cc->cfg, 0, sizeof(cc->cfg));
 	memset(&cc->hint, 0, sizeof(cc->hint));
 	TAILQ_INIT(&cc->nameq);
 
@@ -82,6 +89,8 @@ client_init(Window win, struct screen_ctx *sc)
 	cc->colormap = wattr.colormap;
 	cc->obwidth = wattr.border_width;
 	cc->bwidth = Conf.bwidth;
+	cc->abwidth = -1;
+	cc->bpixel = 0;
 
 	client_set_name(cc);
 	conf_client(cc);
@@ -117,8 +126,7 @@ client_init(Window win, struct screen_ctx *sc)
 
 	TAILQ_INSERT_TAIL(&sc->clientq, cc, entry);
 
-	xu_ewmh_net_client_list(sc);
-	xu_ewmh_net_client_list_stacking(sc);
+	xu_ewmh_net_client_lists_defer(sc);
 	xu_ewmh_restore_net_wm_state(cc);
 
 	xu_get_wm_state(cc->win, &state);
@@ -142,7 +150,11 @@ client_init(Window win, struct screen_ctx *sc)
 			group_assign(NULL, cc);
 	}
 out:
-	XSync(X_Dpy, False);
+	layout_mark(sc, cc->gc);
+	ctl_event("map 0x%lx %d %s", cc->win,
+	    (cc->gc != NULL) ? cc->gc->num : 0, cc->name);
+
+	xu_sync(False);
 	XUngrabServer(X_Dpy);
 
 	return cc;
@@ -212,24 +224,28 @@ client_remove(struct client_ctx *cc)
 	struct winname		*wn;
 
 	TAILQ_REMOVE(&sc->clientq, cc, entry);
+	layout_mark(sc, cc->gc);
+	menu_forget(cc);
+	ctl_event("unmap 0x%lx", cc->win);
+	shm_client_remove(cc);
 
-	xu_ewmh_net_client_list(sc);
-	xu_ewmh_net_client_list_stacking(sc);
+	xu_ewmh_net_client_lists_defer(sc);
 
 	if (cc->flags & CLIENT_ACTIVE)
 		xu_ewmh_net_active_window(sc, None);
 
 	while ((wn = TAILQ_FIRST(&cc->nameq)) != NULL) {
 		TAILQ_REMOVE(&cc->nameq, wn, entry);
-		free(wn->name);
-		free(wn);
+		xfree(wn->name);
+		xfree(wn);
 	}
 
-	free(cc->name);
-	free(cc->label);
-	free(cc->res_class);
-	free(cc->res_name);
-	free(cc);
+	xfree(cc->name);
+	xfree(cc->label);
+	xfree(cc->res_class);
+	xfree(cc->res_name);
+	xfree(cc->fstate);
+	xfree(cc);
 }
 
 void
@@ -265,6 +281,7 @@ client_set_active(struct client_ctx *cc)
 	client_draw_border(cc);
 	conf_grab_mouse(cc->win);
 	xu_ewmh_net_active_window(sc, cc->win);
+	shm_client(cc);
 }
 
 void
@@ -282,6 +299,7 @@ client_toggle_hidden(struct client_ctx *cc)
 {
 	cc->flags ^= CLIENT_HIDDEN;
 	xu_ewmh_set_net_wm_state(cc);
+	shm_client(cc);
 }
 
 void
@@ -303,6 +321,7 @@ client_toggle_sticky(struct client_ctx *cc)
 {
 	cc->flags ^= CLIENT_STICKY;
 	xu_ewmh_set_net_wm_state(cc);
+	shm_client(cc);
 }
 
 void
@@ -500,6 +519,7 @@ client_config(struct client_ctx *cc)
 	cn.override_redirect = 0;
 
 	XSendEvent(X_Dpy, cc->win, False, StructureNotifyMask, (XEvent *)&cn);
+	shm_client(cc);
 }
 
 void
@@ -552,6 +572,8 @@ client_hide(struct client_ctx *cc)
 	}
 	cc->flags |= CLIENT_HIDDEN;
 	xu_set_wm_state(cc->win, IconicState);
+	layout_mark(cc->sc, cc->gc);
+	shm_client(cc);
 }
 
 void
@@ -562,13 +584,18 @@ client_show(struct client_ctx *cc)
 	cc->flags &= ~CLIENT_HIDDEN;
 	xu_set_wm_state(cc->win, NormalState);
 	client_draw_border(cc);
+	layout_mark(cc->sc, cc->gc);
+	shm_client(cc);
 }
 
 void
 client_urgency(struct client_ctx *cc)
 {
-	if (!(cc->flags & CLIENT_ACTIVE))
+	if (!(cc->flags & (CLIENT_ACTIVE | CLIENT_URGENCY))) {
 		cc->flags |= CLIENT_URGENCY;
+		ctl_event("urgent 0x%lx", cc->win);
+		shm_client(cc);
+	}
 }
 
 void
@@ -594,9 +621,21 @@ client_draw_border(struct client_ctx *cc)
 
 	if (cc->flags & CLIENT_URGENCY)
 		pixel = sc->xftcolor[CWM_COLOR_BORDER_URGENCY].pixel;
-
-	XSetWindowBorderWidth(X_Dpy, cc->win, (unsigned int)cc->bwidth);
-	XSetWindowBorder(X_Dpy, cc->win, pixel | (0xffu << 24));
+	pixel |= (0xffu << 24);
+
+	/* Only talk to the server about what actually changed. */
+	if (cc->abwidth != cc->bwidth) {
+		XSetWindowBorderWidth(X_Dpy, cc->win, (unsigned int)cc->bwidth);
+		cc->abwidth = cc->bwidth;
+		Stats.border_requests++;
+	} else
+		Stats.border_skipped++;
+	if (cc->bpixel != pixel) {
+		XSetWindowBorder(X_Dpy, cc->win, pixel);
+		cc->bpixel = pixel;
+		Stats.border_requests++;
+	} else
+		Stats.border_skipped++;
 }
 
 static void
@@ -664,7 +703,7 @@ client_set_name(struct client_ctx *cc)
 	struct winname	*wn, *wnnxt;
 	int		 i = 0;
 
-	free(cc->name);
+	xfree(cc->name);
 	if (!xu_get_strprop(cc->win, ewmh[_NET_WM_NAME], &cc->name))
 		if (!xu_get_strprop(cc->win, XA_WM_NAME, &cc->name))
 			cc->name = xstrdup("");
@@ -672,8 +711,8 @@ client_set_name(struct client_ctx *cc)
 	TAILQ_FOREACH_SAFE(wn, &cc->nameq, entry, wnnxt) {
 		if (strcmp(wn->name, cc->name) == 0) {
 			TAILQ_REMOVE(&cc->nameq, wn, entry);
-			free(wn->name);
-			free(wn);
+			xfree(wn->name);
+			xfree(wn);
 		}
 		i++;
 	}
@@ -685,9 +724,11 @@ client_set_name(struct client_ctx *cc)
 	if ((i + 1) > Conf.nameqlen) {
 		wn = TAILQ_FIRST(&cc->nameq);
 		TAILQ_REMOVE(&cc->nameq, wn, entry);
-		free(wn->name);
-		free(wn);
+		xfree(wn->name);
+		xfree(wn);
 	}
+
+	shm_client(cc);
 }
 
 static void
@@ -717,6 +758,9 @@ client_placement(struct client_ctx *cc)
 		xu_ptr_get(sc->rootwin, &xmouse, &ymouse);
 		area = screen_area(sc, xmouse, ymouse, 1);
 
+		if (Conf.placement == PLACEMENT_SMART && place_smart(cc, area))
+			return;
+
 		xmouse = MAX(MAX(xmouse, area.x) - cc->geom.w / 2, area.x);
 		ymouse = MAX(MAX(ymouse, area.y) - cc->geom.h / 2, area.y);
 
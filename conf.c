@@ -22,6 +22,7 @@
 #include "queue.h"
 
 #include <err.h>
+#include <ctype.h>
 #include <errno.h>
 #include <limits.h>
 #include <pwd.h>
@@ -35,6 +36,15 @@
 static const char	*conf_bind_mask(const char *, unsigned int *);
 static void		 conf_unbind_key(struct conf *, struct bind_ctx *);
 static void		 conf_unbind_mouse(struct conf *, struct bind_ctx *);
+static XftFont		*conf_font(struct screen_ctx *, const char *);
+static void		 conf_colors(struct screen_ctx *);
+static unsigned int	 conf_rule_hash(const char *, const char *);
+static struct autogroup	**conf_rule_slot(struct conf *, const char *,
+			     const char *);
+static void		 conf_trie_free(struct ignore_node *);
+static void		 conf_kbd_modmask(struct bind_ctx *);
+static int		 conf_binds_equal(struct bind_ctx *, struct bind_ctx *,
+			     int);
 
 static const struct {
 	int		 num;
@@ -146,6 +156,11 @@ static const struct {
 	{ FUNC_SC(group-rcycle, group_cycle, (CWM_CYCLE_REVERSE)) },
 	{ FUNC_SC(group-last, group_last, 0) },
 	{ FUNC_SC(group-toggle-all, group_toggle_all, 0) },
+	{ FUNC_SC(group-layout-float, group_layout, LAYOUT_FLOAT) },
+	{ FUNC_SC(group-layout-tile, group_layout, LAYOUT_TILE) },
+	{ FUNC_SC(group-layout-grid, group_layout, LAYOUT_GRID) },
+	{ FUNC_SC(group-layout-monocle, group_layout, LAYOUT_MONOCLE) },
+	{ FUNC_SC(group-layout-spiral, group_layout, LAYOUT_SPIRAL) },
 	{ FUNC_SC(group-toggle-1, group_toggle, 1) },
 	{ FUNC_SC(group-toggle-2, group_toggle, 2) },
 	{ FUNC_SC(group-toggle-3, group_toggle, 3) },
@@ -292,8 +307,13 @@ conf_init(struct conf *c)
 	c->htile = 50;
 	c->vtile = 50;
 	c->snapdist = 0;
+	c->placement = PLACEMENT_POINTER;
+	c->configurerate = 0;
 	c->ngroups = 0;
 	c->nameqlen = 5;
+	c->agtab = NULL;
+	c->agtabsz = 0;
+	c->ignoretrie = NULL;
 
 	TAILQ_INIT(&c->ignoreq);
 	TAILQ_INIT(&c->autogroupq);
@@ -339,44 +359,221 @@ conf_clear(struct conf *c)
 	struct cmd_ctx		*cmd, *wm;
 	int			 i;
 
+	conf_rules_free(c);
+
 	while ((cmd = TAILQ_FIRST(&c->cmdq)) != NULL) {
 		TAILQ_REMOVE(&c->cmdq, cmd, entry);
-		free(cmd->name);
-		free(cmd->path);
-		free(cmd);
+		xfree(cmd->name);
+		xfree(cmd->path);
+		xfree(cmd);
 	}
 	while ((wm = TAILQ_FIRST(&c->wmq)) != NULL) {
 		TAILQ_REMOVE(&c->wmq, wm, entry);
-		free(wm->name);
-		free(wm->path);
-		free(wm);
+		xfree(wm->name);
+		xfree(wm->path);
+		xfree(wm);
 	}
 	while ((kb = TAILQ_FIRST(&c->keybindq)) != NULL) {
 		TAILQ_REMOVE(&c->keybindq, kb, entry);
-		free(kb);
+		xfree(kb->cargs->cmd);
+		xfree(kb->cargs);
+		xfree(kb);
 	}
 	while ((ag = TAILQ_FIRST(&c->autogroupq)) != NULL) {
 		TAILQ_REMOVE(&c->autogroupq, ag, entry);
-		free(ag->class);
-		free(ag->name);
-		free(ag);
+		xfree(ag->class);
+		xfree(ag->name);
+		xfree(ag);
 	}
 	while ((wn = TAILQ_FIRST(&c->ignoreq)) != NULL) {
 		TAILQ_REMOVE(&c->ignoreq, wn, entry);
-		free(wn->name);
-		free(wn);
+		xfree(wn->name);
+		xfree(wn);
 	}
 	while ((mb = TAILQ_FIRST(&c->mousebindq)) != NULL) {
 		TAILQ_REMOVE(&c->mousebindq, mb, entry);
-		free(mb);
+		xfree(mb->cargs->cmd);
+		xfree(mb->cargs);
+		xfree(mb);
+	}
+	for (i = 0; i < CWM_COLOR_NITEMS; i++)
+		xfree(c->color[i]);
+
+	xfree(c->conf_file);
+	xfree(c->known_hosts);
+	xfree(c->font);
+	xfree(c->wmname);
+}
+
+#define CONF_SWAPQ(a, b, qtype, etype) do {				\
+	struct qtype	 _q;						\
+	struct etype	*_e;						\
+									\
+	TAILQ_INIT(&_q);						\
+	while ((_e = TAILQ_FIRST(a)) != NULL) {				\
+		TAILQ_REMOVE(a, _e, entry);				\
+		TAILQ_INSERT_TAIL(&_q, _e, entry);			\
+	}								\
+	while ((_e = TAILQ_FIRST(b)) != NULL) {				\
+		TAILQ_REMOVE(b, _e, entry);				\
+		TAILQ_INSERT_TAIL(a, _e, entry);			\
+	}								\
+	while ((_e = TAILQ_FIRST(&_q)) != NULL) {			\
+		TAILQ_REMOVE(&_q, _e, entry);				\
+		TAILQ_INSERT_TAIL(b, _e, entry);			\
+	}								\
+} while (0)
+
+#define CONF_SWAP(a, b) do {						\
+	char	*_t = (a);						\
+	(a) = (b);							\
+	(b) = _t;							\
+} while (0)
+
+/*
+ * Re-read the configuration file into a fresh conf and apply only what
+ * changed to the running window manager; clients are left in place.
+ * On a parse error the live configuration is kept.
+ */
+int
+conf_reload(void)
+{
+	struct conf		 nc;
+	struct screen_ctx	*sc;
+	struct client_ctx	*cc;
+	struct bind_ctx		*kb;
+	struct cmd_ctx		*cmd;
+	XftFont			*font;
+	int			 keys, mouse, colors = 0, fontchg, gap;
+	int			 obwidth = Conf.bwidth, i;
+
+	conf_init(&nc);
+	xfree(nc.conf_file);
+	nc.conf_file = xstrdup(Conf.conf_file);
+	if (parse_config(nc.conf_file, &nc) == -1) {
+		warnx("error parsing config file, keeping old configuration");
+		conf_clear(&nc);
+		return -1;
+	}
+
+	TAILQ_FOREACH(kb, &nc.keybindq, entry)
+		conf_kbd_modmask(kb);
+	keys = !conf_binds_equal(TAILQ_FIRST(&Conf.keybindq),
+	    TAILQ_FIRST(&nc.keybindq), 0);
+	mouse = !conf_binds_equal(TAILQ_FIRST(&Conf.mousebindq),
+	    TAILQ_FIRST(&nc.mousebindq), 1);
+	for (i = 0; i < CWM_COLOR_NITEMS; i++) {
+		if (strcmp(Conf.color[i], nc.color[i]) != 0)
+			colors = 1;
+	}
+	fontchg = (strcmp(Conf.font, nc.font) != 0);
+	gap = (memcmp(&Conf.gap, &nc.gap, sizeof(nc.gap)) != 0);
+
+	/* Make sure the new font opens everywhere before committing to it. */
+	if (fontchg) {
+		TAILQ_FOREACH(sc, &Screenq, entry) {
+			if ((font = conf_font(sc, nc.font)) == NULL) {
+				warnx("%s: XftFontOpenName: %s", __func__,
+				    nc.font);
+				fontchg = 0;
+				break;
+			}
+			XftFontClose(X_Dpy, font);
+		}
 	}
+
+	/* Open menus must not keep the commands about to be freed. */
+	TAILQ_FOREACH(cmd, &Conf.cmdq, entry)
+		menu_forget(cmd);
+	TAILQ_FOREACH(cmd, &Conf.wmq, entry)
+		menu_forget(cmd);
+
+	/* Swap the new state in; conf_clear() then frees the old. */
+	if (keys)
+		CONF_SWAPQ(&Conf.keybindq, &nc.keybindq, keybind_q, bind_ctx);
+	if (mouse)
+		CONF_SWAPQ(&Conf.mousebindq, &nc.mousebindq, mousebind_q,
+		    bind_ctx);
+	CONF_SWAPQ(&Conf.autogroupq, &nc.autogroupq, autogroup_q, autogroup);
+	CONF_SWAPQ(&Conf.ignoreq, &nc.ignoreq, ignore_q, winname);
+	CONF_SWAPQ(&Conf.cmdq, &nc.cmdq, cmd_q, cmd_ctx);
+	CONF_SWAPQ(&Conf.wmq, &nc.wmq, wm_q, cmd_ctx);
 	for (i = 0; i < CWM_COLOR_NITEMS; i++)
-		free(c->color[i]);
+		CONF_SWAP(Conf.color[i], nc.color[i]);
+	if (fontchg)
+		CONF_SWAP(Conf.font, nc.font);
+	CONF_SWAP(Conf.known_hosts, nc.known_hosts);
+	Conf.stickygroups = nc.stickygroups;
+	Conf.nameqlen = nc.nameqlen;
+	Conf.bwidth = nc.bwidth;
+	Conf.mamount = nc.mamount;
+	Conf.snapdist = nc.snapdist;
+	Conf.placement = nc.placement;
+	Conf.configurerate = nc.configurerate;
+	Conf.htile = nc.htile;
+	Conf.vtile = nc.vtile;
+	Conf.gap = nc.gap;
+	conf_clear(&nc);
+	conf_rules_compile(&Conf);
+
+	TAILQ_FOREACH(sc, &Screenq, entry) {
+		sc->snapdist = Conf.snapdist;
+		if (keys)
+			conf_grab_kbd(sc->rootwin);
+		if (fontchg) {
+			XftFontClose(X_Dpy, sc->xftfont);
+			sc->xftfont = conf_font(sc, Conf.font);
+		}
+		if (colors) {
+			for (i = 0; i < CWM_COLOR_NITEMS; i++)
+				XftColorFree(X_Dpy, sc->visual, sc->colormap,
+				    &sc->xftcolor[i]);
+			conf_colors(sc);
+			XSetWindowBackground(X_Dpy, sc->prop.win,
+			    sc->xftcolor[CWM_COLOR_MENU_BG].pixel);
+		}
+		if (gap) {
+			sc->gap = Conf.gap;
+			screen_update_geometry(sc);
+		}
+		if (gap || Conf.bwidth != obwidth)
+			layout_mark_all(sc);
+		TAILQ_FOREACH(cc, &sc->clientq, entry) {
+			if (mouse)
+				conf_grab_mouse(cc->win);
+			if (cc->bwidth == obwidth)
+				cc->bwidth = Conf.bwidth;
+			if (colors || Conf.bwidth != obwidth)
+				client_draw_border(cc);
+		}
+	}
+	LOG_DEBUG1("keys %d mouse %d colors %d font %d gap %d",
+	    keys, mouse, colors, fontchg, gap);
 
-	free(c->conf_file);
-	free(c->known_hosts);
-	free(c->font);
-	free(c->wmname);
+	return 0;
+}
+
+static int
+conf_binds_equal(struct bind_ctx *a, struct bind_ctx *b, int mouse)
+{
+	for (; a != NULL && b != NULL;
+	    a = TAILQ_NEXT(a, entry), b = TAILQ_NEXT(b, entry)) {
+		if (mouse && a->press.button != b->press.button)
+			return 0;
+		if (!mouse && a->press.keysym != b->press.keysym)
+			return 0;
+		if (a->modmask != b->modmask ||
+		    a->callback != b->callback ||
+		    a->context != b->context ||
+		    a->cargs->flag != b->cargs->flag)
+			return 0;
+		if ((a->cargs->cmd == NULL) != (b->cargs->cmd == NULL))
+			return 0;
+		if (a->cargs->cmd != NULL &&
+		    strcmp(a->cargs->cmd, b->cargs->cmd) != 0)
+			return 0;
+	}
+	return (a == NULL && b == NULL);
 }
 
 void
@@ -391,9 +588,9 @@ conf_cmd_add(struct conf *c, const char *name, const char *path)
 	TAILQ_FOREACH_SAFE(cmdtmp, &c->cmdq, entry, cmdnxt) {
 		if (strcmp(cmdtmp->name, name) == 0) {
 			TAILQ_REMOVE(&c->cmdq, cmdtmp, entry);
-			free(cmdtmp->name);
-			free(cmdtmp->path);
-			free(cmdtmp);
+			xfree(cmdtmp->name);
+			xfree(cmdtmp->path);
+			xfree(cmdtmp);
 		}
 	}
 	TAILQ_INSERT_TAIL(&c->cmdq, cmd, entry);
@@ -411,9 +608,9 @@ conf_wm_add(struct conf *c, const char *name, const char *path)
 	TAILQ_FOREACH_SAFE(wmtmp, &c->cmdq, entry, wmnxt) {
 		if (strcmp(wmtmp->name, name) == 0) {
 			TAILQ_REMOVE(&c->wmq, wmtmp, entry);
-			free(wmtmp->name);
-			free(wmtmp->path);
-			free(wmtmp);
+			xfree(wmtmp->name);
+			xfree(wmtmp->path);
+			xfree(wmtmp);
 		}
 	}
 	TAILQ_INSERT_TAIL(&c->wmq, wm, entry);
@@ -465,34 +662,174 @@ conf_cursor(struct conf *c)
 		c->cursor[i] = XCreateFontCursor(X_Dpy, cursor_binds[i]);
 }
 
+static unsigned int
+conf_rule_hash(const char *class, const char *name)
+{
+	unsigned int	 h = 2166136261U;
+
+	for (; *class != '\0'; class++)
+		h = (h ^ (unsigned char)*class) * 16777619U;
+	if (name != NULL) {
+		h = (h ^ 0xff) * 16777619U;
+		for (; *name != '\0'; name++)
+			h = (h ^ (unsigned char)*name) * 16777619U;
+	}
+	return h;
+}
+
+static struct autogroup **
+conf_rule_slot(struct conf *c, const char *class, const char *name)
+{
+	struct autogroup	**slot;
+	unsigned int		 i;
+
+	i = conf_rule_hash(class, name) & (c->agtabsz - 1);
+	for (;; i = (i + 1) & (c->agtabsz - 1)) {
+		slot = &c->agtab[i];
+		if (*slot == NULL)
+			break;
+		if (strcmp((*slot)->class, class) != 0)
+			continue;
+		if (((*slot)->name == NULL && name == NULL) ||
+		    ((*slot)->name != NULL && name != NULL &&
+		    strcmp((*slot)->name, name) == 0))
+			break;
+	}
+	return slot;
+}
+
+/*
+ * Compile autogroup rules into a hash table keyed on class, or class
+ * and name, and ignore rules into a case-folded prefix trie, so that
+ * matching a new window does not depend on the number of rules.
+ */
+void
+conf_rules_compile(struct conf *c)
+{
+	struct autogroup	*ag;
+	struct winname		*wn;
+	struct ignore_node	**np, *n;
+	const char		*p;
+	unsigned int		 nag = 0;
+
+	conf_rules_free(c);
+
+	TAILQ_FOREACH(ag, &c->autogroupq, entry)
+		nag++;
+	for (c->agtabsz = 16; c->agtabsz < nag * 2; c->agtabsz <<= 1)
+		;
+	c->agtab = xcalloc(c->agtabsz, sizeof(*c->agtab));
+	/* Later rules override earlier ones with the same key. */
+	TAILQ_FOREACH(ag, &c->autogroupq, entry)
+		*conf_rule_slot(c, ag->class, ag->name) = ag;
+
+	/* The root node stands for the empty prefix. */
+	if (!TAILQ_EMPTY(&c->ignoreq))
+		c->ignoretrie = xcalloc(1, sizeof(*c->ignoretrie));
+	TAILQ_FOREACH(wn, &c->ignoreq, entry) {
+		n = c->ignoretrie;
+		for (p = wn->name; *p != '\0'; p++) {
+			np = &n->child;
+			while (*np != NULL &&
+			    (*np)->ch != tolower((unsigned char)*p))
+				np = &(*np)->sibling;
+			if (*np == NULL) {
+				*np = xcalloc(1, sizeof(**np));
+				(*np)->ch = tolower((unsigned char)*p);
+			}
+			n = *np;
+		}
+		n->terminal = 1;
+	}
+}
+
+static void
+conf_trie_free(struct ignore_node *n)
+{
+	struct ignore_node	*next;
+
+	for (; n != NULL; n = next) {
+		next = n->sibling;
+		conf_trie_free(n->child);
+		xfree(n);
+	}
+}
+
+void
+conf_rules_free(struct conf *c)
+{
+	xfree(c->agtab);
+	c->agtab = NULL;
+	c->agtabsz = 0;
+	conf_trie_free(c->ignoretrie);
+	c->ignoretrie = NULL;
+}
+
+int
+conf_autogroup_find(const char *class, const char *name)
+{
+	struct autogroup	*ag;
+
+	if (Conf.agtab == NULL)
+		return -1;
+	/* A class and name match takes precedence over a class match. */
+	if ((ag = *conf_rule_slot(&Conf, class, name)) != NULL ||
+	    (ag = *conf_rule_slot(&Conf, class, NULL)) != NULL)
+		return ag->num;
+	return -1;
+}
+
 void
 conf_client(struct client_ctx *cc)
 {
-	struct winname	*wn;
+	struct ignore_node	*n;
+	const char		*p;
 
-	TAILQ_FOREACH(wn, &Conf.ignoreq, entry) {
-		if (strncasecmp(wn->name, cc->name, strlen(wn->name)) == 0) {
+	/* Walk the trie; any terminal node on the way is a prefix match. */
+	for (n = Conf.ignoretrie, p = cc->name; n != NULL; p++) {
+		if (n->terminal) {
 			cc->flags |= CLIENT_IGNORE;
 			break;
 		}
+		if (*p == '\0')
+			break;
+		for (n = n->child; n != NULL; n = n->sibling) {
+			if (n->ch == tolower((unsigned char)*p))
+				break;
+		}
 	}
 }
 
 void
 conf_screen(struct screen_ctx *sc)
 {
-	unsigned int	 i;
-	XftColor	 xc;
-
 	sc->gap = Conf.gap;
 	sc->snapdist = Conf.snapdist;
 
-	sc->xftfont = XftFontOpenXlfd(X_Dpy, sc->which, Conf.font);
-	if (sc->xftfont == NULL) {
-		sc->xftfont = XftFontOpenName(X_Dpy, sc->which, Conf.font);
-		if (sc->xftfont == NULL)
-			errx(1, "%s: XftFontOpenName: %s", __func__, Conf.font);
-	}
+	if ((sc->xftfont = conf_font(sc, Conf.font)) == NULL)
+		errx(1, "%s: XftFontOpenName: %s", __func__, Conf.font);
+
+	conf_colors(sc);
+
+	conf_grab_kbd(sc->rootwin);
+}
+
+static XftFont *
+conf_font(struct screen_ctx *sc, const char *name)
+{
+	XftFont		*font;
+
+	font = XftFontOpenXlfd(X_Dpy, sc->which, name);
+	if (font == NULL)
+		font = XftFontOpenName(X_Dpy, sc->which, name);
+	return font;
+}
+
+static void
+conf_colors(struct screen_ctx *sc)
+{
+	unsigned int	 i;
+	XftColor	 xc;
 
 	for (i = 0; i < nitems(color_binds); i++) {
 		if (i == CWM_COLOR_MENU_FONT_SEL && *Conf.color[i] == '\0') {
@@ -511,8 +848,6 @@ conf_screen(struct screen_ctx *sc)
 			    color_binds[i], &sc->xftcolor[i]);
 		}
 	}
-
-	conf_grab_kbd(sc->rootwin);
 }
 
 void
@@ -561,12 +896,12 @@ conf_bind_key(struct conf *c, const char *bind, const char *cmd)
 	kb->press.keysym = XStringToKeysym(key);
 	if (kb->press.keysym == NoSymbol) {
 		warnx("unknown symbol: %s", key);
-		free(kb);
+		xfree(kb);
 		return 0;
 	}
 	conf_unbind_key(c, kb);
 	if (cmd == NULL) {
-		free(kb);
+		xfree(kb);
 		return 1;
 	}
 	cargs = xcalloc(1, sizeof(*cargs));
@@ -588,6 +923,24 @@ out:
 	return 1;
 }
 
+/* Look up a bindable function by name. */
+int
+conf_func(const char *name, void (**cb)(void *, struct cargs *),
+    enum context *context, int *flag)
+{
+	unsigned int	 i;
+
+	for (i = 0; i < nitems(name_to_func); i++) {
+		if (strcmp(name_to_func[i].tag, name) != 0)
+			continue;
+		*cb = name_to_func[i].handler;
+		*context = name_to_func[i].context;
+		*flag = name_to_func[i].flag;
+		return 1;
+	}
+	return 0;
+}
+
 static void
 conf_unbind_key(struct conf *c, struct bind_ctx *unbind)
 {
@@ -598,9 +951,9 @@ conf_unbind_key(struct conf *c, struct bind_ctx *unbind)
 		    ((key->modmask == unbind->modmask) &&
 		     (key->press.keysym == unbind->press.keysym))) {
 			TAILQ_REMOVE(&c->keybindq, key, entry);
-			free(key->cargs->cmd);
-			free(key->cargs);
-			free(key);
+			xfree(key->cargs->cmd);
+			xfree(key->cargs);
+			xfree(key);
 		}
 	}
 }
@@ -622,12 +975,12 @@ conf_bind_mouse(struct conf *c, const char *bind, const char *cmd)
 	mb->press.button = strtonum(button, Button1, Button5, &errstr);
 	if (errstr) {
 		warnx("button number is %s: %s", errstr, button);
-		free(mb);
+		xfree(mb);
 		return 0;
 	}
 	conf_unbind_mouse(c, mb);
 	if (cmd == NULL) {
-		free(mb);
+		xfree(mb);
 		return 1;
 	}
 	cargs = xcalloc(1, sizeof(*cargs));
@@ -659,9 +1012,9 @@ conf_unbind_mouse(struct conf *c, struct bind_ctx *unbind)
 		    ((mb->modmask == unbind->modmask) &&
 		     (mb->press.button == unbind->press.button))) {
 			TAILQ_REMOVE(&c->mousebindq, mb, entry);
-			free(mb->cargs->cmd);
-			free(mb->cargs);
-			free(mb);
+			xfree(mb->cargs->cmd);
+			xfree(mb->cargs);
+			xfree(mb);
 		}
 	}
 }
@@ -679,9 +1032,7 @@ conf_grab_kbd(Window win)
 		kc = XKeysymToKeycode(X_Dpy, kb->press.keysym);
 		if (kc == 0)
 			continue;
-		if ((XkbKeycodeToKeysym(X_Dpy, kc, 0, 0) != kb->press.keysym) &&
-		    (XkbKeycodeToKeysym(X_Dpy, kc, 0, 1) == kb->press.keysym))
-			kb->modmask |= ShiftMask;
+		conf_kbd_modmask(kb);
 
 		for (i = 0; i < nitems(ignore_mods); i++)
 			XGrabKey(X_Dpy, kc, (kb->modmask | ignore_mods[i]), win,
@@ -689,6 +1040,20 @@ conf_grab_kbd(Window win)
 	}
 }
 
+/* Keysyms only reachable with shift need it in the grab. */
+static void
+conf_kbd_modmask(struct bind_ctx *kb)
+{
+	KeyCode		 kc;
+
+	kc = XKeysymToKeycode(X_Dpy, kb->press.keysym);
+	if (kc == 0)
+		return;
+	if ((XkbKeycodeToKeysym(X_Dpy, kc, 0, 0) != kb->press.keysym) &&
+	    (XkbKeycodeToKeysym(X_Dpy, kc, 0, 1) == kb->press.keysym))
+		kb->modmask |= ShiftMask;
+}
+
 void
 conf_grab_mouse(Window win)
 {
@@ -0,0 +1,463 @@
+/*
+ * calmwm - the calm window manager
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * $OpenBSD$
+ */
+
+/*
+ * Control socket.  Each line sent is one command: a function name as
+ * used for bindings, optionally followed by a target, which is either
+ * a window id or @n for every window in group n.  Every command gets a
+ * reply line, "ok" or "error" and a reason.  All complete lines read in
+ * one go are run as a batch within the same turn of the main loop.
+ *
+ * After "subscribe", the connection also receives one line per change
+ * of state, starting with the current state.  Events are buffered and
+ * written once per turn of the main loop; a subscriber that falls more
+ * than CTL_MAXOUT bytes behind is disconnected.
+ */
+
+#include <sys/types.h>
+#include "queue.h"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calmwm.h"
+
+#define CTL_MAXLINE	1024
+#define CTL_MAXOUT	(256 * 1024)
+
+struct ctl_conn {
+	int		 fd;
+	int		 subscribed;
+	int		 dead;
+	char		 in[CTL_MAXLINE];
+	size_t		 inlen;
+	char		*out;
+	size_t		 outlen;
+	size_t		 outsz;
+};
+
+static int		 ctl_fd = -1;
+static char		*ctl_path;
+static struct ctl_conn	*ctl_conns[CTL_MAXCONN];
+static int		 ctl_nsub;
+
+static void	 ctl_accept(void);
+static void	 ctl_read(struct ctl_conn *);
+static void	 ctl_flush(struct ctl_conn *);
+static void	 ctl_drop(struct ctl_conn *);
+static void	 ctl_exec(struct ctl_conn *, char *);
+static void	 ctl_subscribe(struct ctl_conn *);
+static void	 ctl_append(struct ctl_conn *, const char *, size_t);
+static void	 ctl_reply(struct ctl_conn *, const char *, ...)
+		     __attribute__((__format__ (printf, 2, 3)));
+
+static int
+ctl_nonblock(int fd)
+{
+	if (fcntl(fd, F_SETFL, O_NONBLOCK) == -1 ||
+	    fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+		return -1;
+	return 0;
+}
+
+void
+ctl_init(const char *path)
+{
+	struct sockaddr_un	 sun;
+	mode_t			 old;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if (strlcpy(sun.sun_path, path, sizeof(sun.sun_path)) >=
+	    sizeof(sun.sun_path))
+		errx(1, "%s: socket path too long", path);
+
+	if ((ctl_fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		err(1, "socket");
+	if (ctl_nonblock(ctl_fd) == -1)
+		err(1, "fcntl");
+
+	/* A socket left behind by an earlier instance is replaced. */
+	(void)unlink(path);
+	old = umask(S_IRWXG | S_IRWXO);
+	if (bind(ctl_fd, (struct sockaddr *)&sun, sizeof(sun)) == -1)
+		err(1, "%s", path);
+	umask(old);
+	if (listen(ctl_fd, 8) == -1)
+		err(1, "listen");
+
+	ctl_path = xstrdup(path);
+	/* Lets scripts started from cwm find it. */
+	setenv("CWM_SOCKET", ctl_path, 1);
+}
+
+void
+ctl_close(void)
+{
+	int	 i;
+
+	if (ctl_fd == -1)
+		return;
+	for (i = 0; i < CTL_MAXCONN; i++) {
+		if (ctl_conns[i] != NULL)
+			ctl_drop(ctl_conns[i]);
+	}
+	close(ctl_fd);
+	ctl_fd = -1;
+	(void)unlink(ctl_path);
+	xfree(ctl_path);
+	ctl_path = NULL;
+}
+
+/* Fill in pfd for the listening socket and connections; returns count. */
+int
+ctl_pollfd(struct pollfd *pfd)
+{
+	struct ctl_conn	*cn;
+	int		 i, n = 0;
+
+	if (ctl_fd == -1)
+		return 0;
+	/* Subscribers that fell behind are dropped here, outside handlers. */
+	for (i = 0; i < CTL_MAXCONN; i++) {
+		if (ctl_conns[i] != NULL && ctl_conns[i]->dead)
+			ctl_drop(ctl_conns[i]);
+	}
+	pfd[n].fd = ctl_fd;
+	pfd[n++].events = POLLIN;
+	for (i = 0; i < CTL_MAXCONN; i++) {
+		if ((cn = ctl_conns[i]) == NULL)
+			continue;
+		pfd[n].fd = cn->fd;
+		pfd[n++].events = POLLIN | ((cn->outlen > 0) ? POLLOUT : 0);
+	}
+	return n;
+}
+
+void
+ctl_dispatch(struct pollfd *pfd, int npfd)
+{
+	struct ctl_conn	*cn;
+	int		 i, j;
+
+	for (i = 1; i < npfd; i++) {
+		if (pfd[i].revents == 0)
+			continue;
+		for (j = 0; j < CTL_MAXCONN; j++) {
+			cn = ctl_conns[j];
+			if (cn != NULL && cn->fd == pfd[i].fd)
+				break;
+		}
+		if (j == CTL_MAXCONN)
+			continue;
+		if (pfd[i].revents & POLLOUT)
+			ctl_flush(cn);
+		else if (pfd[i].revents & (POLLIN | POLLHUP | POLLERR))
+			ctl_read(cn);
+	}
+	if (npfd > 0 && (pfd[0].revents & POLLIN))
+		ctl_accept();
+}
+
+static void
+ctl_accept(void)
+{
+	struct ctl_conn	*cn;
+	int		 fd, i;
+
+	while ((fd = accept(ctl_fd, NULL, NULL)) != -1) {
+		for (i = 0; i < CTL_MAXCONN; i++) {
+			if (ctl_conns[i] == NULL)
+				break;
+		}
+		if (i == CTL_MAXCONN || ctl_nonblock(fd) == -1) {
+			close(fd);
+			continue;
+		}
+		cn = xcalloc(1, sizeof(*cn));
+		cn->fd = fd;
+		ctl_conns[i] = cn;
+	}
+	if (errno != EWOULDBLOCK && errno != EAGAIN && errno != EINTR)
+		warn("accept");
+}
+
+static void
+ctl_drop(struct ctl_conn *cn)
+{
+	int	 i;
+
+	for (i = 0; i < CTL_MAXCONN; i++) {
+		if (ctl_conns[i] == cn)
+			ctl_conns[i] = NULL;
+	}
+	if (cn->subscribed)
+		ctl_nsub--;
+	close(cn->fd);
+	xfree(cn->out);
+	xfree(cn);
+}
+
+static void
+ctl_read(struct ctl_conn *cn)
+{
+	char		*line, *nl;
+	ssize_t		 n;
+	size_t		 off;
+
+	n = read(cn->fd, cn->in + cn->inlen, sizeof(cn->in) - cn->inlen);
+	if (n == -1 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if (n > 0)
+		cn->inlen += n;
+
+	/* Run every complete line as one batch. */
+	for (off = 0; (nl = memchr(cn->in + off, '\n',
+	    cn->inlen - off)) != NULL; off = nl - cn->in + 1) {
+		*nl = '\0';
+		line = cn->in + off;
+		ctl_exec(cn, line);
+	}
+	memmove(cn->in, cn->in + off, cn->inlen - off);
+	cn->inlen -= off;
+
+	if (cn->inlen == sizeof(cn->in)) {
+		ctl_reply(cn, "error line too long");
+		n = 0;
+	}
+	ctl_flush(cn);
+	if (n <= 0)
+		ctl_drop(cn);
+}
+
+static void
+ctl_flush(struct ctl_conn *cn)
+{
+	ssize_t	 n;
+
+	while (cn->outlen > 0 && !cn->dead) {
+		if ((n = write(cn->fd, cn->out, cn->outlen)) == -1) {
+			if (errno == EINTR)
+				continue;
+			/* Gone (EPIPE) or broken: drop it from ctl_pollfd(). */
+			if (errno != EAGAIN) {
+				cn->dead = 1;
+				cn->outlen = 0;
+			}
+			return;
+		}
+		memmove(cn->out, cn->out + n, cn->outlen - n);
+		cn->outlen -= n;
+	}
+}
+
+static void
+ctl_append(struct ctl_conn *cn, const char *s, size_t len)
+{
+	size_t	 i;
+
+	if (cn->dead)
+		return;
+	if (cn->outlen + len + 1 > CTL_MAXOUT) {
+		cn->dead = 1;
+		cn->outlen = 0;
+		return;
+	}
+	if (cn->outlen + len + 1 > cn->outsz) {
+		cn->outsz = cn->outlen + len + 1 + CTL_MAXLINE;
+		cn->out = xreallocarray(cn->out, cn->outsz, 1);
+	}
+	/* Titles are arbitrary text; keep one event per line. */
+	for (i = 0; i < len; i++) {
+		cn->out[cn->outlen + i] =
+		    (s[i] == '\n' || s[i] == '\r') ? ' ' : s[i];
+	}
+	cn->outlen += len;
+	cn->out[cn->outlen++] = '\n';
+}
+
+static void
+ctl_reply(struct ctl_conn *cn, const char *fmt, ...)
+{
+	va_list	 ap;
+	char	*s;
+	int	 len;
+
+	va_start(ap, fmt);
+	len = xvasprintf(&s, fmt, ap);
+	va_end(ap);
+
+	ctl_append(cn, s, len);
+	xfree(s);
+}
+
+/* Queue an event line for every subscriber. */
+void
+ctl_event(const char *fmt, ...)
+{
+	va_list	 ap;
+	char	*s;
+	int	 i, len;
+
+	if (ctl_nsub == 0)
+		return;
+
+	va_start(ap, fmt);
+	len = xvasprintf(&s, fmt, ap);
+	va_end(ap);
+
+	for (i = 0; i < CTL_MAXCONN; i++) {
+		if (ctl_conns[i] != NULL && ctl_conns[i]->subscribed)
+			ctl_append(ctl_conns[i], s, len);
+	}
+	xfree(s);
+}
+
+static void
+ctl_subscribe(struct ctl_conn *cn)
+{
+	struct screen_ctx	*sc;
+	struct client_ctx	*cc, *active = NULL;
+
+	ctl_reply(cn, "ok");
+	if (cn->subscribed)
+		return;
+
+	/* Start with the current state, as if it had just happened. */
+	TAILQ_FOREACH(sc, &Screenq, entry) {
+		if (sc->group_active != NULL)
+			ctl_reply(cn, "group %d", sc->group_active->num);
+		TAILQ_FOREACH(cc, &sc->clientq, entry) {
+			ctl_reply(cn, "map 0x%lx %d %s", cc->win,
+			    (cc->gc != NULL) ? cc->gc->num : 0, cc->name);
+			if (cc->flags & CLIENT_URGENCY)
+				ctl_reply(cn, "urgent 0x%lx", cc->win);
+			if (cc->flags & CLIENT_ACTIVE)
+				active = cc;
+		}
+	}
+	ctl_reply(cn, "focus 0x%lx", (active != NULL) ? active->win : None);
+
+	cn->subscribed = 1;
+	ctl_nsub++;
+}
+
+static void
+ctl_exec(struct ctl_conn *cn, char *line)
+{
+	void			(*cb)(void *, struct cargs *);
+	enum context		 context;
+	struct cargs		 cargs;
+	struct screen_ctx	*sc;
+	struct client_ctx	*cc;
+	struct group_ctx	*gc;
+	Window			*wins;
+	const char		*errstr;
+	char			*name, *target, *end;
+	unsigned long		 win;
+	int			 i, n, num;
+
+	while (*line == ' ' || *line == '\t')
+		line++;
+	if (*line == '\0' || *line == '#')
+		return;
+	name = strsep(&line, " \t");
+	target = (line != NULL) ? strsep(&line, " \t") : NULL;
+
+	if (strcmp(name, "subscribe") == 0) {
+		ctl_subscribe(cn);
+		return;
+	}
+
+	memset(&cargs, 0, sizeof(cargs));
+	if (!conf_func(name, &cb, &context, &cargs.flag)) {
+		ctl_reply(cn, "error unknown function %s", name);
+		return;
+	}
+	cargs.xev = CWM_XEV_KEY;
+	Stats.ctl_commands++;
+
+	if (target == NULL || *target == '\0') {
+		cc = client_current(NULL);
+		sc = (cc != NULL) ? cc->sc : TAILQ_FIRST(&Screenq);
+		if (context == CWM_CONTEXT_SC)
+			(*cb)(sc, &cargs);
+		else if (cc != NULL)
+			(*cb)(cc, &cargs);
+		else {
+			ctl_reply(cn, "error no active window");
+			return;
+		}
+	} else if (*target == '@') {
+		if (context != CWM_CONTEXT_CC) {
+			ctl_reply(cn, "error %s does not take a group", name);
+			return;
+		}
+		num = strtonum(target + 1, 0, Conf.ngroups - 1, &errstr);
+		if (errstr != NULL) {
+			ctl_reply(cn, "error group %s is %s", target + 1,
+			    errstr);
+			return;
+		}
+		cc = client_current(NULL);
+		sc = (cc != NULL) ? cc->sc : TAILQ_FIRST(&Screenq);
+		TAILQ_FOREACH(gc, &sc->groupq, entry) {
+			if (gc->num == num)
+				break;
+		}
+		/* The function may change the list; collect windows first. */
+		n = 0;
+		TAILQ_FOREACH(cc, &sc->clientq, entry)
+			n++;
+		wins = xreallocarray(NULL, n + 1, sizeof(*wins));
+		n = 0;
+		TAILQ_FOREACH(cc, &sc->clientq, entry) {
+			if (cc->gc == ((num == 0) ? NULL : gc))
+				wins[n++] = cc->win;
+		}
+		for (i = 0; i < n; i++) {
+			if ((cc = client_find(wins[i])) != NULL)
+				(*cb)(cc, &cargs);
+		}
+		xfree(wins);
+	} else {
+		errno = 0;
+		win = strtoul(target, &end, 0);
+		if (*end != '\0' || errno != 0 ||
+		    (cc = client_find(win)) == NULL) {
+			ctl_reply(cn, "error no window %s", target);
+			return;
+		}
+		if (context == CWM_CONTEXT_SC)
+			(*cb)(cc->sc, &cargs);
+		else
+			(*cb)(cc, &cargs);
+	}
+	ctl_reply(cn, "ok");
+}
@@ -0,0 +1,83 @@
+/*
+ * calmwm - the calm window manager
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * $OpenBSD$
+ */
+
+/*
+ * Layout of the shared memory window state published with cwm -m.
+ * This header is self-contained so that readers can include it.
+ *
+ * The segment is protected by a sequence lock: seq is odd while cwm
+ * updates it.  A reader copies what it needs and retries if seq was odd
+ * or changed meanwhile:
+ *
+ *	do {
+ *		while ((s = st->seq) & 1)
+ *			;
+ *		__sync_synchronize();
+ *		... copy from st ...
+ *		__sync_synchronize();
+ *	} while (st->seq != s);
+ */
+
+#ifndef _CWMSTATE_H_
+#define _CWMSTATE_H_
+
+#include <stdint.h>
+
+#define CWM_STATE_MAGIC		0x736d7763	/* "cwms" */
+#define CWM_STATE_VERSION	1
+#define CWM_STATE_NCLIENTS	512
+#define CWM_STATE_NGROUPS	10
+#define CWM_STATE_NAMELEN	32
+#define CWM_STATE_TITLELEN	128
+
+/* Client flags, as far as they are of interest to readers. */
+#define CWM_STATE_HIDDEN	0x0001
+#define CWM_STATE_URGENT	0x0002
+#define CWM_STATE_STICKY	0x0004
+#define CWM_STATE_FULLSCREEN	0x0008
+#define CWM_STATE_MAXIMIZED	0x0010
+
+struct cwm_state_client {
+	uint32_t	 window;
+	uint32_t	 screen;
+	uint32_t	 group;
+	uint32_t	 flags;
+	int32_t		 x;
+	int32_t		 y;
+	int32_t		 w;
+	int32_t		 h;
+	char		 class[CWM_STATE_NAMELEN];
+	uint32_t	 title;	/* offset of the title in the segment */
+};
+
+struct cwm_state {
+	uint32_t		 magic;
+	uint32_t		 version;
+	volatile uint32_t	 seq;
+	uint32_t		 truncated; /* more clients than slots */
+	uint32_t		 active; /* active window, or 0 */
+	uint32_t		 group; /* current group */
+	uint32_t		 nclients;
+	char			 groupname[CWM_STATE_NGROUPS]
+				    [CWM_STATE_NAMELEN];
+	struct cwm_state_client	 client[CWM_STATE_NCLIENTS];
+	char			 title[CWM_STATE_NCLIENTS]
+				    [CWM_STATE_TITLELEN];
+};
+
+#endif /* _CWMSTATE_H_ */
@@ -0,0 +1,60 @@
+#!/usr/bin/perl
+# Convert a cwm debug trace, as written on SIGUSR2 or on a crash, to
+# text, or with -j to the Chrome trace event format (chrome://tracing,
+# Perfetto).
+#
+# usage: cwmtrace.pl [-j] trace
+
+use strict;
+use warnings;
+
+my $json = 0;
+if (@ARGV && $ARGV[0] eq '-j') {
+	$json = 1;
+	shift;
+}
+die "usage: cwmtrace.pl [-j] trace\n" unless @ARGV == 1;
+
+open(my $fh, '<:raw', $ARGV[0]) or die "$ARGV[0]: $!\n";
+
+sub readn {
+	my ($n) = @_;
+	my $buf = '';
+	return '' if $n == 0;
+	read($fh, $buf, $n) == $n or die "$ARGV[0]: short read\n";
+	return $buf;
+}
+
+my ($magic, $version, $count) = unpack('Z8 L L', readn(16));
+die "$ARGV[0]: not a cwm trace\n" unless $magic eq 'CWMRING';
+die "$ARGV[0]: unknown version $version\n" unless $version == 1;
+
+# struct log_rec: usec, level, nargs, 6 args, funclen, fmtlen, pad
+my $reclen = 8 + 4 + 4 + 6 * 8 + 2 + 2 + 4;
+my (@out, $t0);
+
+for (1 .. $count) {
+	my ($usec, $level, $nargs, @rest) = unpack('Q L L Q6 S S L',
+	    readn($reclen));
+	my @args = @rest[0 .. 5];
+	my ($funclen, $fmtlen) = @rest[6, 7];
+	my $func = readn($funclen);
+	my $fmt = readn($fmtlen);
+
+	# Strings and pointers were not kept, only their address.
+	$fmt =~ s/%[-+ #0-9.]*[sp]/<0x%lx>/g;
+	my $msg = sprintf($fmt, @args[0 .. $nargs - 1]);
+
+	$t0 = $usec unless defined $t0;
+	if ($json) {
+		$msg =~ s/(["\\])/\\$1/g;
+		push @out, sprintf('{"name":"%s","cat":"debug%d","ph":"i",' .
+		    '"s":"t","ts":%d,"pid":1,"tid":1,"args":{"msg":"%s"}}',
+		    $func, $level, $usec - $t0, $msg);
+	} else {
+		printf("%12.6f debug%d: %s: %s\n", ($usec - $t0) / 1e6,
+		    $level, $func, $msg);
+	}
+}
+
+print '{"traceEvents":[', "\n", join(",\n", @out), "\n]}\n" if $json;
@@ -34,7 +34,7 @@
 
 static struct group_ctx	*group_next(struct group_ctx *);
 static struct group_ctx	*group_prev(struct group_ctx *);
-static void		 group_restack(struct group_ctx *);
+static void		 group_restack(struct group_ctx *, int);
 static void		 group_set_active(struct group_ctx *);
 
 void
@@ -43,7 +43,10 @@ group_assign(struct group_ctx *gc, struct client_ctx *cc)
 	if ((gc != NULL) && (gc->num == 0))
 		gc = NULL;
 
+	layout_mark(cc->sc, cc->gc);
 	cc->gc = gc;
+	layout_mark(cc->sc, cc->gc);
+	shm_client(cc);
 
 	xu_ewmh_set_net_wm_desktop(cc);
 }
@@ -78,12 +81,12 @@ group_show(struct group_ctx *gc)
 		     (cc->flags & CLIENT_HIDDEN))
 			client_show(cc);
 	}
-	group_restack(gc);
+	group_restack(gc, 0);
 	group_set_active(gc);
 }
 
 static void
-group_restack(struct group_ctx *gc)
+group_restack(struct group_ctx *gc, int raise)
 {
 	struct screen_ctx	*sc = gc->sc;
 	struct client_ctx	*cc;
@@ -118,8 +121,11 @@ group_restack(struct group_ctx *gc)
 		}
 	}
 
+	/* XRestackWindows() leaves the first window where it is. */
+	if (raise && nwins > 0)
+		XRaiseWindow(X_Dpy, winlist[0]);
 	XRestackWindows(X_Dpy, winlist, nwins);
-	free(winlist);
+	xfree(winlist);
 }
 
 void
@@ -131,6 +137,8 @@ group_init(struct screen_ctx *sc, int num, const char *name)
 	gc->sc = sc;
 	gc->name = xstrdup(name);
 	gc->num = num;
+	gc->layout = LAYOUT_FLOAT;
+	gc->layout_dirty = 0;
 	TAILQ_INSERT_TAIL(&sc->groupq, gc, entry);
 
 	if (num == 1)
@@ -145,6 +153,8 @@ group_set_active(struct group_ctx *gc)
 	sc->group_active = gc;
 
 	xu_ewmh_net_current_desktop(sc);
+	ctl_event("group %d", gc->num);
+	shm_group(gc->num);
 }
 
 void
@@ -210,20 +220,81 @@ group_holds_only_hidden(struct group_ctx *gc)
 	return 1;
 }
 
+/*
+ * Switch to a single group in one pass: every client is visited once,
+ * all map/unmap requests go out under one server grab and the shown
+ * group is restacked with a single XRestackWindows().
+ */
 void
 group_only(struct screen_ctx *sc, int idx)
 {
-	struct group_ctx	*gc;
+	struct group_ctx	*gc, *showgc = NULL;
+	struct client_ctx	*cc;
+	unsigned long long	 start, usec;
+	int			 nshow = 0, nhide = 0, active = 0;
+
+	start = u_time_usec();
 
 	if (sc->group_last != sc->group_active)
 		sc->group_last = sc->group_active;
 
 	TAILQ_FOREACH(gc, &sc->groupq, entry) {
-		if (gc->num == idx)
-			group_show(gc);
-		else
-			group_hide(gc);
+		if (gc->num == idx) {
+			showgc = gc;
+			break;
+		}
 	}
+
+	/* Record stacking order of the visible clients before unmapping. */
+	screen_updatestackingorder(sc);
+
+	XGrabServer(X_Dpy);
+	/* Readers of the shared state see the switch as one update. */
+	shm_begin();
+	TAILQ_FOREACH(cc, &sc->clientq, entry) {
+		if (cc->gc == NULL || (cc->flags & CLIENT_STICKY))
+			continue;
+		if (cc->gc == showgc) {
+			if (!(cc->flags & CLIENT_HIDDEN))
+				continue;
+			XMapWindow(X_Dpy, cc->win);
+			cc->flags &= ~CLIENT_HIDDEN;
+			xu_set_wm_state(cc->win, NormalState);
+			client_draw_border(cc);
+			shm_client(cc);
+			nshow++;
+		} else {
+			if (cc->flags & CLIENT_HIDDEN)
+				continue;
+			XUnmapWindow(X_Dpy, cc->win);
+			if (cc->flags & CLIENT_ACTIVE) {
+				cc->flags &= ~CLIENT_ACTIVE;
+				active = 1;
+			}
+			cc->flags |= CLIENT_HIDDEN;
+			xu_set_wm_state(cc->win, IconicState);
+			shm_client(cc);
+			nhide++;
+		}
+	}
+	if (active)
+		xu_ewmh_net_active_window(sc, None);
+	if (showgc != NULL) {
+		if (nshow > 0)
+			layout_mark(sc, showgc);
+		group_restack(showgc, nshow > 0);
+		group_set_active(showgc);
+	}
+	shm_end();
+	XUngrabServer(X_Dpy);
+	XFlush(X_Dpy);
+
+	usec = u_time_usec() - start;
+	Stats.group_switch++;
+	Stats.group_switch_usec += usec;
+	Stats.group_switch_max = MAX(Stats.group_switch_max, usec);
+	LOG_DEBUG1("group %d: %d shown, %d hidden, %llu usec",
+	    idx, nshow, nhide, usec);
 }
 
 void
@@ -350,23 +421,13 @@ int
 group_autogroup(struct client_ctx *cc)
 {
 	struct screen_ctx	*sc = cc->sc;
-	struct autogroup	*ag;
 	struct group_ctx	*gc;
-	int			 num = -1, both_match = 0;
+	int			 num;
 
 	if (cc->res_class == NULL || cc->res_name == NULL)
 		return 0;
 
-	TAILQ_FOREACH(ag, &Conf.autogroupq, entry) {
-		if (strcmp(ag->class, cc->res_class) == 0) {
-			if ((ag->name != NULL) &&
-			    (strcmp(ag->name, cc->res_name) == 0)) {
-				num = ag->num;
-				both_match = 1;
-			} else if (ag->name == NULL && !both_match)
-				num = ag->num;
-		}
-	}
+	num = conf_autogroup_find(cc->res_class, cc->res_name);
 
 	TAILQ_FOREACH(gc, &sc->groupq, entry) {
 		if (gc->num == num) {
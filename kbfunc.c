@@ -43,10 +43,35 @@
 extern sig_atomic_t	 cwm_status;
 
 static void kbfunc_amount(int, int, int *, int *);
+static int kbfunc_repeats(struct cargs *);
+static int kbfunc_accel(struct cargs *, int);
 static void kbfunc_client_move_kb(void *, struct cargs *);
 static void kbfunc_client_move_mb(void *, struct cargs *);
 static void kbfunc_client_resize_kb(void *, struct cargs *);
 static void kbfunc_client_resize_mb(void *, struct cargs *);
+static void kbfunc_drag_move(struct client_ctx *, XMotionEvent *);
+static void kbfunc_drag_resize(struct client_ctx *, XMotionEvent *);
+static void kbfunc_drag_end(void);
+static void kbfunc_menu_client_done(struct menu *, void *);
+static void kbfunc_menu_cmd_done(struct menu *, void *);
+static void kbfunc_menu_group_done(struct menu *, void *);
+static void kbfunc_menu_wm_done(struct menu *, void *);
+static void kbfunc_menu_exec_done(struct menu *, void *);
+static void kbfunc_menu_ssh_done(struct menu *, void *);
+static void kbfunc_client_menu_label_done(struct menu *, void *);
+
+enum drag_type {
+	DRAG_NONE,
+	DRAG_MOVE,
+	DRAG_RESIZE
+};
+
+static struct {
+	enum drag_type		 type;
+	Window			 win;
+	struct screen_ctx	*sc;
+	Time			 ltime;
+} drag;
 
 void
 kbfunc_cwm_status(void *ctx, struct cargs *cargs)
@@ -78,6 +103,68 @@ kbfunc_amount(int flags, int amt, int *mx, int *my)
 	}
 }
 
+struct repeat_scan {
+	struct cargs	*cargs;
+	int		 done;
+};
+
+static Bool
+kbfunc_repeat_match(Display *dpy, XEvent *e, XPointer arg)
+{
+	struct repeat_scan	*rs = (struct repeat_scan *)arg;
+
+	/* Only ever take the event at the head of the queue. */
+	if (rs->done)
+		return False;
+	rs->done = 1;
+	return (e->type == KeyPress &&
+	    e->xkey.keycode == rs->cargs->keycode &&
+	    (e->xkey.state & ~IGNOREMODMASK) == rs->cargs->state);
+}
+
+/*
+ * Take queued autorepeats of the triggering key off the front of the
+ * queue, so a held key is applied as one step per batch instead of one
+ * round trip per repeat.  Returns the number of presses folded.
+ */
+static int
+kbfunc_repeats(struct cargs *cargs)
+{
+	struct repeat_scan	 rs = { cargs, 0 };
+	XEvent			 ev;
+	int			 n = 1;
+
+	if (cargs->xev != CWM_XEV_KEY)
+		return n;
+	while (XCheckIfEvent(X_Dpy, &ev, kbfunc_repeat_match, (XPointer)&rs)) {
+		xev_record_fold(&ev);
+		rs.done = 0;
+		n++;
+	}
+	return n;
+}
+
+/* Speed up a held key: double the step every 16 repeats, up to 8x. */
+static int
+kbfunc_accel(struct cargs *cargs, int n)
+{
+	static unsigned long long	 last;
+	static unsigned int		 lastkey;
+	static int			 run;
+	unsigned long long		 now;
+
+	now = u_time_usec();
+	if (cargs->xev == CWM_XEV_KEY && cargs->keycode == lastkey &&
+	    now - last < 250000)
+		run += n;
+	else
+		run = 0;
+	last = now;
+	lastkey = cargs->keycode;
+
+	return n << MIN(run / 16, 3);
+}
+
 void
 kbfunc_ptrmove(void *ctx, struct cargs *cargs)
 {
@@ -120,7 +207,9 @@ kbfunc_client_move_kb(void *ctx, struct cargs *cargs)
 	if (cc->flags & CLIENT_FREEZE)
 		return;
 
-	kbfunc_amount(cargs->flag, Conf.mamount, &mx, &my);
+	kbfunc_amount(cargs->flag,
+	    Conf.mamount * kbfunc_accel(cargs, kbfunc_repeats(cargs)),
+	    &mx, &my);
 
 	cc->geom.x += mx;
 	if (cc->geom.x < -(cc->geom.w + cc->bwidth - 1))
@@ -145,22 +234,22 @@ kbfunc_client_move_kb(void *ctx, struct cargs *cargs)
 
 	client_move(cc);
 	client_ptr_inbound(cc, 1);
-	XSync(X_Dpy, True);
 }
 
+/*
+ * Mouse moves and resizes are a drag state fed by the main event
+ * loop, so other clients keep being serviced meanwhile.  Only the
+ * window id is kept: the client may go away during the drag.
+ */
 static void
 kbfunc_client_move_mb(void *ctx, struct cargs *cargs)
 {
 	struct client_ctx	*cc = ctx;
-	XEvent			 ev;
-	Time			 ltime = 0;
 	struct screen_ctx	*sc = cc->sc;
-	struct geom		 area;
-	int			 move = 1;
 
 	client_raise(cc);
 
-	if (cc->flags & CLIENT_FREEZE)
+	if ((cc->flags & CLIENT_FREEZE) || drag.type != DRAG_NONE)
 		return;
 
 	client_ptr_inbound(cc, 1);
@@ -172,40 +261,33 @@ kbfunc_client_move_mb(void *ctx, struct cargs *cargs)
 
 	screen_prop_win_create(sc, cc->win);
 	screen_prop_win_draw(sc, "%+5d%+5d", cc->geom.x, cc->geom.y);
-	while (move) {
-		XMaskEvent(X_Dpy, MOUSEMASK, &ev);
-		switch (ev.type) {
-		case MotionNotify:
-			/* not more than 60 times / second */
-			if ((ev.xmotion.time - ltime) <= (1000 / 60))
-				continue;
-			ltime = ev.xmotion.time;
-
-			cc->geom.x = ev.xmotion.x_root - cc->ptr.x - cc->bwidth;
-			cc->geom.y = ev.xmotion.y_root - cc->ptr.y - cc->bwidth;
-
-			area = screen_area(sc,
-			    cc->geom.x + cc->geom.w / 2,
-			    cc->geom.y + cc->geom.h / 2, 1);
-			cc->geom.x += client_snapcalc(cc->geom.x,
-			    cc->geom.x + cc->geom.w + (cc->bwidth * 2),
-			    area.x, area.x + area.w, sc->snapdist);
-			cc->geom.y += client_snapcalc(cc->geom.y,
-			    cc->geom.y + cc->geom.h + (cc->bwidth * 2),
-			    area.y, area.y + area.h, sc->snapdist);
-			client_move(cc);
-			screen_prop_win_draw(sc,
-			    "%+5d%+5d", cc->geom.x, cc->geom.y);
-			break;
-		case ButtonRelease:
-			move = 0;
-			break;
-		}
-	}
-	if (ltime)
-		client_move(cc);
-	screen_prop_win_destroy(sc);
-	XUngrabPointer(X_Dpy, CurrentTime);
+
+	drag.type = DRAG_MOVE;
+	drag.win = cc->win;
+	drag.sc = sc;
+	drag.ltime = 0;
+}
+
+static void
+kbfunc_drag_move(struct client_ctx *cc, XMotionEvent *ev)
+{
+	struct screen_ctx	*sc = cc->sc;
+	struct geom		 area;
+
+	cc->geom.x = ev->x_root - cc->ptr.x - cc->bwidth;
+	cc->geom.y = ev->y_root - cc->ptr.y - cc->bwidth;
+
+	area = screen_area(sc,
+	    cc->geom.x + cc->geom.w / 2,
+	    cc->geom.y + cc->geom.h / 2, 1);
+	cc->geom.x += client_snapcalc(cc->geom.x,
+	    cc->geom.x + cc->geom.w + (cc->bwidth * 2),
+	    area.x, area.x + area.w, sc->snapdist);
+	cc->geom.y += client_snapcalc(cc->geom.y,
+	    cc->geom.y + cc->geom.h + (cc->bwidth * 2),
+	    area.y, area.y + area.h, sc->snapdist);
+	client_move(cc);
+	screen_prop_win_draw(sc, "%+5d%+5d", cc->geom.x, cc->geom.y);
 }
 
 static void
@@ -221,7 +303,7 @@ kbfunc_client_resize_kb(void *ctx, struct cargs *cargs)
 	if (!(cc->hint.flags & PResizeInc))
 		amt = Conf.mamount;
 
-	kbfunc_amount(cargs->flag, amt, &mx, &my);
+	kbfunc_amount(cargs->flag, amt * kbfunc_repeats(cargs), &mx, &my);
 
 	if ((cc->geom.w += mx * cc->hint.incw) < cc->hint.minw)
 		cc->geom.w = cc->hint.minw;
@@ -234,19 +316,15 @@ kbfunc_client_resize_kb(void *ctx, struct cargs *cargs)
 
 	client_resize(cc, 1);
 	client_ptr_inbound(cc, 1);
-	XSync(X_Dpy, True);
 }
 
 static void
 kbfunc_client_resize_mb(void *ctx, struct cargs *cargs)
 {
 	struct client_ctx	*cc = ctx;
-	XEvent			 ev;
-	Time			 ltime = 0;
 	struct screen_ctx	*sc = cc->sc;
-	int			 resize = 1;
 
-	if (cc->flags & CLIENT_FREEZE)
+	if ((cc->flags & CLIENT_FREEZE) || drag.type != DRAG_NONE)
 		return;
 
 	client_raise(cc);
@@ -261,34 +339,79 @@ kbfunc_client_resize_mb(void *ctx, struct cargs *cargs)
 
 	screen_prop_win_create(sc, cc->win);
 	screen_prop_win_draw(sc, "%4d x %-4d", cc->dim.w, cc->dim.h);
-	while (resize) {
-		XMaskEvent(X_Dpy, MOUSEMASK, &ev);
-		switch (ev.type) {
-		case MotionNotify:
-			/* not more than 60 times / second */
-			if ((ev.xmotion.time - ltime) <= (1000 / 60))
-				continue;
-			ltime = ev.xmotion.time;
-
-			cc->geom.w = ev.xmotion.x - cc->geom.x - cc->bwidth;
-			cc->geom.h = ev.xmotion.y - cc->geom.y - cc->bwidth;
-			client_apply_sizehints(cc);
-			client_resize(cc, 1);
-			screen_prop_win_draw(sc,
-			    "%4d x %-4d", cc->dim.w, cc->dim.h);
-			break;
-		case ButtonRelease:
-			resize = 0;
-			break;
+
+	drag.type = DRAG_RESIZE;
+	drag.win = cc->win;
+	drag.sc = sc;
+	drag.ltime = 0;
+}
+
+static void
+kbfunc_drag_resize(struct client_ctx *cc, XMotionEvent *ev)
+{
+	cc->geom.w = ev->x - cc->geom.x - cc->bwidth;
+	cc->geom.h = ev->y - cc->geom.y - cc->bwidth;
+	client_apply_sizehints(cc);
+	client_resize(cc, 1);
+	screen_prop_win_draw(cc->sc, "%4d x %-4d", cc->dim.w, cc->dim.h);
+}
+
+static void
+kbfunc_drag_end(void)
+{
+	struct client_ctx	*cc;
+
+	if ((cc = client_find(drag.win)) != NULL) {
+		if (drag.ltime) {
+			if (drag.type == DRAG_MOVE)
+				client_move(cc);
+			else
+				client_resize(cc, 1);
 		}
+		/* Make sure the pointer stays within the window. */
+		if (drag.type == DRAG_RESIZE)
+			client_ptr_inbound(cc, 0);
 	}
-	if (ltime)
-		client_resize(cc, 1);
-	screen_prop_win_destroy(sc);
+	/* Gone with its client's window otherwise; errors are ignored. */
+	screen_prop_win_destroy(drag.sc);
 	XUngrabPointer(X_Dpy, CurrentTime);
+	drag.type = DRAG_NONE;
+}
+
+/* Feed an event to the drag in progress; returns 1 if it was used. */
+int
+kbfunc_drag_event(XEvent *e)
+{
+	struct client_ctx	*cc;
+
+	if (drag.type == DRAG_NONE)
+		return 0;
 
-	/* Make sure the pointer stays within the window. */
-	client_ptr_inbound(cc, 0);
+	switch (e->type) {
+	case MotionNotify:
+		if ((cc = client_find(drag.win)) == NULL) {
+			kbfunc_drag_end();
+			break;
+		}
+		/* not more than 60 times / second */
+		if ((e->xmotion.time - drag.ltime) <= (1000 / 60))
+			break;
+		drag.ltime = e->xmotion.time;
+		if (drag.type == DRAG_MOVE)
+			kbfunc_drag_move(cc, &e->xmotion);
+		else
+			kbfunc_drag_resize(cc, &e->xmotion);
+		break;
+	case ButtonPress:
+		/* No other mouse bindings until the drag is over. */
+		break;
+	case ButtonRelease:
+		kbfunc_drag_end();
+		break;
+	default:
+		return 0;
+	}
+	return 1;
 }
 
 void
@@ -519,6 +642,12 @@ kbfunc_group_toggle_all(void *ctx, struct cargs *cargs)
 	group_toggle_all(ctx);
 }
 
+void
+kbfunc_group_layout(void *ctx, struct cargs *cargs)
+{
+	layout_set(ctx, cargs->flag);
+}
+
 void
 kbfunc_group_close(void *ctx, struct cargs *cargs)
 {
@@ -535,8 +664,7 @@ void
 kbfunc_menu_client(void *ctx, struct cargs *cargs)
 {
 	struct screen_ctx	*sc = ctx;
-	struct client_ctx	*cc, *old_cc;
-	struct menu		*mi;
+	struct client_ctx	*cc;
 	struct menu_q		 menuq;
 	int			 mflags = 0;
 
@@ -550,16 +678,22 @@ kbfunc_menu_client(void *ctx, struct cargs *cargs)
 			menuq_add(&menuq, cc, NULL);
 	}
 
-	if ((mi = menu_filter(sc, &menuq, "window", NULL, mflags,
-	    search_match_client, search_print_client)) != NULL) {
-		cc = (struct client_ctx *)mi->ctx;
-		client_show(cc);
-		if ((old_cc = client_current(sc)) != NULL)
-			client_ptr_save(old_cc);
-		client_ptr_warp(cc);
-	}
+	menu_filter(sc, &menuq, "window", NULL, mflags,
+	    search_match_client, search_print_client,
+	    kbfunc_menu_client_done, sc);
+}
 
-	menuq_clear(&menuq);
+static void
+kbfunc_menu_client_done(struct menu *mi, void *arg)
+{
+	struct screen_ctx	*sc = arg;
+	struct client_ctx	*cc, *old_cc;
+
+	cc = (struct client_ctx *)mi->ctx;
+	client_show(cc);
+	if ((old_cc = client_current(sc)) != NULL)
+		client_ptr_save(old_cc);
+	client_ptr_warp(cc);
 }
 
 void
@@ -567,7 +701,6 @@ kbfunc_menu_cmd(void *ctx, struct cargs *cargs)
 {
 	struct screen_ctx	*sc = ctx;
 	struct cmd_ctx		*cmd;
-	struct menu		*mi;
 	struct menu_q		 menuq;
 	int			 mflags = 0;
 
@@ -582,13 +715,16 @@ kbfunc_menu_cmd(void *ctx, struct cargs *cargs)
 		menuq_add(&menuq, cmd, NULL);
 	}
 
-	if ((mi = menu_filter(sc, &menuq, "application", NULL, mflags,
-	    search_match_cmd, search_print_cmd)) != NULL) {
-		cmd = (struct cmd_ctx *)mi->ctx;
-		u_spawn(cmd->path);
-	}
+	menu_filter(sc, &menuq, "application", NULL, mflags,
+	    search_match_cmd, search_print_cmd, kbfunc_menu_cmd_done, NULL);
+}
+
+static void
+kbfunc_menu_cmd_done(struct menu *mi, void *arg)
+{
+	struct cmd_ctx		*cmd = (struct cmd_ctx *)mi->ctx;
 
-	menuq_clear(&menuq);
+	u_spawn(cmd->path);
 }
 
 void
@@ -596,7 +732,6 @@ kbfunc_menu_group(void *ctx, struct cargs *cargs)
 {
 	struct screen_ctx	*sc = ctx;
 	struct group_ctx	*gc;
-	struct menu		*mi;
 	struct menu_q		 menuq;
 	int			 mflags = 0;
 
@@ -610,14 +745,18 @@ kbfunc_menu_group(void *ctx, struct cargs *cargs)
 		menuq_add(&menuq, gc, NULL);
 	}
 
-	if ((mi = menu_filter(sc, &menuq, "group", NULL, mflags,
-	    search_match_group, search_print_group)) != NULL) {
-		gc = (struct group_ctx *)mi->ctx;
-		(group_holds_only_hidden(gc)) ?
-		    group_show(gc) : group_hide(gc);
-	}
+	menu_filter(sc, &menuq, "group", NULL, mflags,
+	    search_match_group, search_print_group,
+	    kbfunc_menu_group_done, NULL);
+}
+
+static void
+kbfunc_menu_group_done(struct menu *mi, void *arg)
+{
+	struct group_ctx	*gc = (struct group_ctx *)mi->ctx;
 
-	menuq_clear(&menuq);
+	(group_holds_only_hidden(gc)) ?
+	    group_show(gc) : group_hide(gc);
 }
 
 void
@@ -625,7 +764,6 @@ kbfunc_menu_wm(void *ctx, struct cargs *cargs)
 {
 	struct screen_ctx	*sc = ctx;
 	struct cmd_ctx		*wm;
-	struct menu		*mi;
 	struct menu_q		 menuq;
 	int			 mflags = 0;
 
@@ -636,15 +774,18 @@ kbfunc_menu_wm(void *ctx, struct cargs *cargs)
 	TAILQ_FOREACH(wm, &Conf.wmq, entry)
 		menuq_add(&menuq, wm, NULL);
 
-	if ((mi = menu_filter(sc, &menuq, "wm", NULL, mflags,
-	    search_match_wm, search_print_wm)) != NULL) {
-		wm = (struct cmd_ctx *)mi->ctx;
-		free(Conf.wm_argv);
-		Conf.wm_argv = xstrdup(wm->path);
-		cwm_status = CWM_EXEC_WM;
-	}
+	menu_filter(sc, &menuq, "wm", NULL, mflags,
+	    search_match_wm, search_print_wm, kbfunc_menu_wm_done, NULL);
+}
+
+static void
+kbfunc_menu_wm_done(struct menu *mi, void *arg)
+{
+	struct cmd_ctx		*wm = (struct cmd_ctx *)mi->ctx;
 
-	menuq_clear(&menuq);
+	xfree(Conf.wm_argv);
+	Conf.wm_argv = xstrdup(wm->path);
+	cwm_status = CWM_EXEC_WM;
 }
 
 void
@@ -657,7 +798,6 @@ kbfunc_menu_exec(void *ctx, struct cargs *cargs)
 	struct stat		 sb;
 	DIR			*dirp;
 	struct dirent		*dp;
-	struct menu		*mi;
 	struct menu_q		 menuq;
 	int			 l, i;
 	int			 mflags = (CWM_MENU_DUMMY | CWM_MENU_FILE);
@@ -698,18 +838,17 @@ kbfunc_menu_exec(void *ctx, struct cargs *cargs)
 		}
 		(void)closedir(dirp);
 	}
-	free(path);
+	xfree(path);
+
+	menu_filter(sc, &menuq, "exec", NULL, mflags,
+	    search_match_exec, search_print_text, kbfunc_menu_exec_done, NULL);
+}
 
-	if ((mi = menu_filter(sc, &menuq, "exec", NULL, mflags,
-	    search_match_exec, search_print_text)) != NULL) {
-		if (mi->text[0] == '\0')
-			goto out;
+static void
+kbfunc_menu_exec_done(struct menu *mi, void *arg)
+{
+	if (mi->text[0] != '\0')
 		u_spawn(mi->text);
-	}
-out:
-	if (mi != NULL && mi->dummy)
-		free(mi);
-	menuq_clear(&menuq);
 }
 
 void
@@ -717,13 +856,10 @@ kbfunc_menu_ssh(void *ctx, struct cargs *cargs)
 {
 	struct screen_ctx	*sc = ctx;
 	struct cmd_ctx		*cmd;
-	struct menu		*mi;
 	struct menu_q		 menuq;
 	FILE			*fp;
 	char			*buf, *lbuf, *p;
 	char			 hostbuf[_POSIX_HOST_NAME_MAX+1];
-	char			 path[PATH_MAX];
-	int			 l;
 	size_t			 len;
 	ssize_t			 slen;
 	int			 mflags = (CWM_MENU_DUMMY);
@@ -757,46 +893,56 @@ kbfunc_menu_ssh(void *ctx, struct cargs *cargs)
 		(void)strlcpy(hostbuf, buf, p - buf + 1);
 		menuq_add(&menuq, NULL, "%s", hostbuf);
 	}
-	free(lbuf);
+	xfree(lbuf);
 	if (ferror(fp))
-		err(1, "%s", path);
+		err(1, "%s", Conf.known_hosts);
 	(void)fclose(fp);
 menu:
-	if ((mi = menu_filter(sc, &menuq, "ssh", NULL, mflags,
-	    search_match_text, search_print_text)) != NULL) {
-		if (mi->text[0] == '\0')
-			goto out;
-		l = snprintf(path, sizeof(path), "%s -T '[ssh] %s' -e ssh %s",
-		    cmd->path, mi->text, mi->text);
-		if (l == -1 || l >= sizeof(path))
-			goto out;
-		u_spawn(path);
-	}
-out:
-	if (mi != NULL && mi->dummy)
-		free(mi);
-	menuq_clear(&menuq);
+	menu_filter(sc, &menuq, "ssh", NULL, mflags,
+	    search_match_text, search_print_text, kbfunc_menu_ssh_done, cmd);
+}
+
+static void
+kbfunc_menu_ssh_done(struct menu *mi, void *arg)
+{
+	struct cmd_ctx		*cmd = arg;
+	char			 path[PATH_MAX];
+	int			 l;
+
+	if (mi->text[0] == '\0')
+		return;
+	l = snprintf(path, sizeof(path), "%s -T '[ssh] %s' -e ssh %s",
+	    cmd->path, mi->text, mi->text);
+	if (l == -1 || l >= sizeof(path))
+		return;
+	u_spawn(path);
 }
 
 void
 kbfunc_client_menu_label(void *ctx, struct cargs *cargs)
 {
 	struct client_ctx	*cc = ctx;
-	struct menu		*mi;
 	struct menu_q		 menuq;
 	int			 mflags = (CWM_MENU_DUMMY);
 
 	TAILQ_INIT(&menuq);
 
-	/* dummy is set, so this will always return */
-	mi = menu_filter(cc->sc, &menuq, "label", cc->label, mflags,
-	    search_match_text, search_print_text);
+	/* dummy is set, so this will always be done */
+	menu_filter(cc->sc, &menuq, "label", cc->label, mflags,
+	    search_match_text, search_print_text,
+	    kbfunc_client_menu_label_done, cc);
+}
+
+/* Not called if the client went away while the menu was open. */
+static void
+kbfunc_client_menu_label_done(struct menu *mi, void *arg)
+{
+	struct client_ctx	*cc = arg;
 
 	if (!mi->abort) {
-		free(cc->label);
+		xfree(cc->label);
 		cc->label = xstrdup(mi->text);
 	}
-	free(mi);
 }
 
 void
@@ -0,0 +1,289 @@
+/*
+ * calmwm - the calm window manager
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * $OpenBSD$
+ */
+
+/*
+ * Per-group automatic layouts.  Changes to a group only mark it dirty;
+ * layout_flush() re-arranges dirty groups once per batch of events.
+ */
+
+#include <sys/types.h>
+#include "queue.h"
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calmwm.h"
+
+struct layout_ent {
+	struct client_ctx	*cc;
+	int			 region;
+	struct geom		 cell;
+};
+
+static void	 layout_tile(struct layout_ent *, int, struct geom);
+static void	 layout_grid(struct layout_ent *, int, struct geom);
+static void	 layout_monocle(struct layout_ent *, int, struct geom);
+static void	 layout_spiral(struct layout_ent *, int, struct geom);
+static void	 layout_apply(struct group_ctx *);
+static int	 layout_cmp(const void *, const void *);
+
+static void (*layouts[LAYOUT_NITEMS])(struct layout_ent *, int, struct geom) = {
+	[LAYOUT_TILE] = layout_tile,
+	[LAYOUT_GRID] = layout_grid,
+	[LAYOUT_MONOCLE] = layout_monocle,
+	[LAYOUT_SPIRAL] = layout_spiral,
+};
+
+static struct group_ctx *
+layout_group(struct screen_ctx *sc, struct group_ctx *gc)
+{
+	/* Clients in nogroup have no group pointer. */
+	if (gc != NULL)
+		return gc;
+	TAILQ_FOREACH(gc, &sc->groupq, entry) {
+		if (gc->num == 0)
+			break;
+	}
+	return gc;
+}
+
+void
+layout_set(struct screen_ctx *sc, int layout)
+{
+	struct group_ctx	*gc = sc->group_active;
+
+	if (gc == NULL || layout < 0 || layout >= LAYOUT_NITEMS)
+		return;
+	gc->layout = layout;
+	gc->layout_dirty = 1;
+}
+
+void
+layout_mark(struct screen_ctx *sc, struct group_ctx *gc)
+{
+	if ((gc = layout_group(sc, gc)) != NULL &&
+	    gc->layout != LAYOUT_FLOAT)
+		gc->layout_dirty = 1;
+}
+
+void
+layout_mark_all(struct screen_ctx *sc)
+{
+	struct group_ctx	*gc;
+
+	TAILQ_FOREACH(gc, &sc->groupq, entry) {
+		if (gc->layout != LAYOUT_FLOAT)
+			gc->layout_dirty = 1;
+	}
+}
+
+void
+layout_flush(void)
+{
+	struct screen_ctx	*sc;
+	struct group_ctx	*gc;
+
+	TAILQ_FOREACH(sc, &Screenq, entry) {
+		TAILQ_FOREACH(gc, &sc->groupq, entry) {
+			if (!gc->layout_dirty)
+				continue;
+			gc->layout_dirty = 0;
+			if (gc->layout != LAYOUT_FLOAT)
+				layout_apply(gc);
+		}
+	}
+}
+
+static int
+layout_cmp(const void *a, const void *b)
+{
+	const struct layout_ent	*la = a, *lb = b;
+
+	if (la->region != lb->region)
+		return (la->region < lb->region) ? -1 : 1;
+	if (la->cc->seq != lb->cc->seq)
+		return (la->cc->seq < lb->cc->seq) ? -1 : 1;
+	return 0;
+}
+
+static void
+layout_apply(struct group_ctx *gc)
+{
+	struct screen_ctx	*sc = gc->sc;
+	struct group_ctx	*cgc = (gc->num == 0) ? NULL : gc;
+	struct client_ctx	*cc;
+	struct region_ctx	*rc;
+	struct layout_ent	*ents = NULL;
+	struct geom		 area, old;
+	int			 i, j, n = 0, nalloc = 0, region;
+
+	/* Single pass over the clients, bucketed by region. */
+	TAILQ_FOREACH(cc, &sc->clientq, entry) {
+		if (cc->gc != cgc ||
+		    (cc->flags & (CLIENT_HIDDEN | CLIENT_IGNORE |
+		    CLIENT_FREEZE | CLIENT_FULLSCREEN)))
+			continue;
+		rc = region_find(sc, cc->geom.x + cc->geom.w / 2,
+		    cc->geom.y + cc->geom.h / 2);
+		region = (rc != NULL) ? rc->num : 0;
+		if (n == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 16;
+			ents = xreallocarray(ents, nalloc, sizeof(*ents));
+		}
+		ents[n].cc = cc;
+		ents[n].region = region;
+		n++;
+	}
+	if (n == 0) {
+		xfree(ents);
+		return;
+	}
+	/* Stable order: by region, then by the order clients were managed. */
+	qsort(ents, n, sizeof(*ents), layout_cmp);
+
+	for (i = 0; i < n; i = j) {
+		for (j = i; j < n && ents[j].region == ents[i].region; j++)
+			;
+		area = sc->work;
+		TAILQ_FOREACH(rc, &sc->regionq, entry) {
+			if (rc->num == ents[i].region) {
+				area = rc->work;
+				break;
+			}
+		}
+		(*layouts[gc->layout])(&ents[i], j - i, area);
+	}
+
+	/* Apply the computed geometries in one batch of requests. */
+	for (i = 0; i < n; i++) {
+		cc = ents[i].cc;
+		old = cc->geom;
+		cc->geom.x = ents[i].cell.x;
+		cc->geom.y = ents[i].cell.y;
+		cc->geom.w = ents[i].cell.w - (cc->bwidth * 2);
+		cc->geom.h = ents[i].cell.h - (cc->bwidth * 2);
+		client_apply_sizehints(cc);
+		if (cc->flags & CLIENT_MAXIMIZED) {
+			cc->flags &= ~CLIENT_MAXIMIZED;
+			xu_ewmh_set_net_wm_state(cc);
+		} else if (memcmp(&old, &cc->geom, sizeof(old)) == 0)
+			continue;
+		client_resize(cc, 0);
+	}
+	xfree(ents);
+}
+
+/* Master on the left, the rest stacked on the right. */
+static void
+layout_tile(struct layout_ent *ents, int n, struct geom area)
+{
+	int	 i, mw, h, y;
+
+	if (n == 1) {
+		ents[0].cell = area;
+		return;
+	}
+	mw = area.w * ((Conf.vtile > 0) ? Conf.vtile : 50) / 100;
+	ents[0].cell = area;
+	ents[0].cell.w = mw;
+
+	h = area.h / (n - 1);
+	y = area.y;
+	for (i = 1; i < n; i++) {
+		ents[i].cell.x = area.x + mw;
+		ents[i].cell.y = y;
+		ents[i].cell.w = area.w - mw;
+		ents[i].cell.h = (i + 1 == n) ? area.y + area.h - y : h;
+		y += h;
+	}
+}
+
+static void
+layout_grid(struct layout_ent *ents, int n, struct geom area)
+{
+	int	 i, cols, rows, col, row, rn, w, h;
+
+	for (cols = 1; cols * cols < n; cols++)
+		;
+	rows = (n + cols - 1) / cols;
+	h = area.h / rows;
+	for (i = 0; i < n; i++) {
+		row = i / cols;
+		col = i % cols;
+		/* The last row spreads its windows over the full width. */
+		rn = (row + 1 == rows) ? n - row * cols : cols;
+		w = area.w / rn;
+		ents[i].cell.x = area.x + col * w;
+		ents[i].cell.y = area.y + row * h;
+		ents[i].cell.w = (col + 1 == rn) ?
+		    area.x + area.w - ents[i].cell.x : w;
+		ents[i].cell.h = (row + 1 == rows) ?
+		    area.y + area.h - ents[i].cell.y : h;
+	}
+}
+
+static void
+layout_monocle(struct layout_ent *ents, int n, struct geom area)
+{
+	int	 i;
+
+	for (i = 0; i < n; i++)
+		ents[i].cell = area;
+}
+
+/* Each window takes half of what is left, turning clockwise. */
+static void
+layout_spiral(struct layout_ent *ents, int n, struct geom area)
+{
+	struct geom	 rest = area, cell;
+	int		 i;
+
+	for (i = 0; i < n; i++) {
+		cell = rest;
+		if (i + 1 < n) {
+			switch (i % 4) {
+			case 0:
+				cell.w = rest.w / 2;
+				rest.x += cell.w;
+				rest.w -= cell.w;
+				break;
+			case 1:
+				cell.h = rest.h / 2;
+				rest.y += cell.h;
+				rest.h -= cell.h;
+				break;
+			case 2:
+				cell.w = rest.w / 2;
+				cell.x = rest.x + rest.w - cell.w;
+				rest.w -= cell.w;
+				break;
+			case 3:
+				cell.h = rest.h / 2;
+				cell.y = rest.y + rest.h - cell.h;
+				rest.h -= cell.h;
+				break;
+			}
+		}
+		ents[i].cell = cell;
+	}
+}
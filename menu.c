@@ -64,6 +64,15 @@ struct menu_ctx {
 	int 			 flags;
 	void (*match)(struct menu_q *, struct menu_q *, char *);
 	void (*print)(struct menu *, int);
+	struct menu_q		 menuq;
+	struct menu_q		 resultq;
+	void (*done)(struct menu *, void *);
+	void			*arg;
+	Window			 focuswin;
+	int			 focusrevert;
+	int			 xsave, ysave;
+	struct menu_ctx		*below; /* menu open below this one */
+	unsigned long long	 start; /* opened, until first drawn */
 };
 static struct menu	*menu_handle_key(XEvent *, struct menu_ctx *,
 			     struct menu_q *, struct menu_q *);
@@ -76,144 +85,293 @@ static void		 menu_draw(struct menu_ctx *, struct menu_q *,
 static void 		 menu_draw_entry(struct menu_ctx *, struct menu_q *,
 			     int, int);
 static int		 menu_calc_entry(struct menu_ctx *, int, int);
-static struct menu	*menu_complete_path(struct menu_ctx *);
+static void		 menu_complete_path(struct menu_ctx *);
+static void		 menu_complete_path_done(struct menu *, void *);
 static int		 menu_keycode(XKeyEvent *, enum ctltype *, char *);
+static int		 menu_grab(struct menu_ctx *);
+static void		 menu_close(struct menu_ctx *, struct menu *);
+static void		 menu_opened(struct menu_ctx *);
+
+static struct menu_ctx	*menu_open;
 
-struct menu *
+/*
+ * Open a menu over the entries of menuq, which it takes over.  The menu
+ * is driven by menu_event() from the main loop; once an entry is
+ * chosen, done is called with it and arg, and the menu goes away.
+ */
+void
 menu_filter(struct screen_ctx *sc, struct menu_q *menuq, const char *prompt,
     const char *initial, int flags,
     void (*match)(struct menu_q *, struct menu_q *, char *),
-    void (*print)(struct menu *, int))
+    void (*print)(struct menu *, int),
+    void (*done)(struct menu *, void *), void *arg)
 {
-	struct menu_ctx		 mc;
-	struct menu_q		 resultq;
-	struct menu		*mi = NULL;
-	XEvent			 e;
-	Window			 focuswin;
-	int			 focusrevert, xsave, ysave, xcur, ycur;
+	struct menu_ctx		*mc;
+	struct menu		*mi;
+
+	mc = xcalloc(1, sizeof(*mc));
+	mc->start = u_time_usec();
 
-	TAILQ_INIT(&resultq);
+	TAILQ_INIT(&mc->menuq);
+	TAILQ_INIT(&mc->resultq);
+	while ((mi = TAILQ_FIRST(menuq)) != NULL) {
+		TAILQ_REMOVE(menuq, mi, entry);
+		TAILQ_INSERT_TAIL(&mc->menuq, mi, entry);
+	}
 
-	xu_ptr_get(sc->rootwin, &xsave, &ysave);
+	xu_ptr_get(sc->rootwin, &mc->xsave, &mc->ysave);
 
-	(void)memset(&mc, 0, sizeof(mc));
-	mc.sc = sc;
-	mc.flags = flags;
-	mc.match = match;
-	mc.print = print;
-	mc.entry = mc.prev = -1;
-	mc.geom.x = xsave;
-	mc.geom.y = ysave;
+	mc->sc = sc;
+	mc->flags = flags;
+	mc->match = match;
+	mc->print = print;
+	mc->done = done;
+	mc->arg = arg;
+	mc->entry = mc->prev = -1;
+	mc->geom.x = mc->xsave;
+	mc->geom.y = mc->ysave;
 
-	if (mc.flags & CWM_MENU_LIST)
-		mc.list = 1;
+	if (mc->flags & CWM_MENU_LIST)
+		mc->list = 1;
 
-	(void)strlcpy(mc.promptstr, prompt, sizeof(mc.promptstr));
+	(void)strlcpy(mc->promptstr, prompt, sizeof(mc->promptstr));
 	if (initial != NULL)
-		(void)strlcpy(mc.searchstr, initial, sizeof(mc.searchstr));
+		(void)strlcpy(mc->searchstr, initial, sizeof(mc->searchstr));
 	else
-		mc.searchstr[0] = '\0';
+		mc->searchstr[0] = '\0';
 
-	mc.win = XCreateSimpleWindow(X_Dpy, sc->rootwin, 0, 0, 1, 1,
+	mc->win = XCreateSimpleWindow(X_Dpy, sc->rootwin, 0, 0, 1, 1,
 	    Conf.bwidth,
 	    sc->xftcolor[CWM_COLOR_MENU_FG].pixel,
 	    sc->xftcolor[CWM_COLOR_MENU_BG].pixel);
-	mc.xftdraw = XftDrawCreate(X_Dpy, mc.win,
+	mc->xftdraw = XftDrawCreate(X_Dpy, mc->win,
 	    sc->visual, sc->colormap);
 
-	XSelectInput(X_Dpy, mc.win, MENUMASK);
-	XMapRaised(X_Dpy, mc.win);
+	XSelectInput(X_Dpy, mc->win, MENUMASK);
+	XMapRaised(X_Dpy, mc->win);
 
-	if (XGrabPointer(X_Dpy, mc.win, False, MENUGRABMASK,
-	    GrabModeAsync, GrabModeAsync, None, Conf.cursor[CF_QUESTION],
-	    CurrentTime) != GrabSuccess) {
-		XftDrawDestroy(mc.xftdraw);
-		XDestroyWindow(X_Dpy, mc.win);
-		return NULL;
+	XGetInputFocus(X_Dpy, &mc->focuswin, &mc->focusrevert);
+
+	if (!menu_grab(mc)) {
+		XftDrawDestroy(mc->xftdraw);
+		XDestroyWindow(X_Dpy, mc->win);
+		menuq_clear(&mc->menuq);
+		xfree(mc);
+		return;
 	}
 
-	XGetInputFocus(X_Dpy, &focuswin, &focusrevert);
-	XSetInputFocus(X_Dpy, mc.win, RevertToPointerRoot, CurrentTime);
+	mc->below = menu_open;
+	menu_open = mc;
+}
+
+static int
+menu_grab(struct menu_ctx *mc)
+{
+	if (XGrabPointer(X_Dpy, mc->win, False, MENUGRABMASK,
+	    GrabModeAsync, GrabModeAsync, None, Conf.cursor[CF_QUESTION],
+	    CurrentTime) != GrabSuccess)
+		return 0;
+
+	XSetInputFocus(X_Dpy, mc->win, RevertToPointerRoot, CurrentTime);
 
 	/* make sure keybindings don't remove keys from the menu stream */
-	XGrabKeyboard(X_Dpy, mc.win, True,
+	XGrabKeyboard(X_Dpy, mc->win, True,
 	    GrabModeAsync, GrabModeAsync, CurrentTime);
+	return 1;
+}
 
-	for (;;) {
-		mc.changed = 0;
+/* Close the menu on top, handing mi, if any, to its caller. */
+static void
+menu_close(struct menu_ctx *mc, struct menu *mi)
+{
+	struct menu		*mr;
+	int			 xcur, ycur;
 
-		XWindowEvent(X_Dpy, mc.win, MENUMASK, &e);
+	menu_open = mc->below;
 
-		switch (e.type) {
-		case KeyPress:
-			if ((mi = menu_handle_key(&e, &mc, menuq, &resultq))
-			    != NULL)
-				goto out;
-			/* FALLTHROUGH */
-		case Expose:
-			menu_draw(&mc, menuq, &resultq);
-			break;
-		case MotionNotify:
-			menu_handle_move(&mc, &resultq,
-			    e.xbutton.x, e.xbutton.y);
-			break;
-		case ButtonRelease:
-			if ((mi = menu_handle_release(&mc, &resultq,
-			    e.xbutton.x, e.xbutton.y)) != NULL)
-				goto out;
-			break;
-		default:
-			break;
-		}
-	}
-out:
-	if ((mc.flags & CWM_MENU_DUMMY) == 0 && mi->dummy) {
+	if ((mc->flags & CWM_MENU_DUMMY) == 0 && mi->dummy) {
 	       	/* no mouse based match */
-		free(mi);
+		xfree(mi);
 		mi = NULL;
 	}
 
-	XftDrawDestroy(mc.xftdraw);
-	XDestroyWindow(X_Dpy, mc.win);
+	XftDrawDestroy(mc->xftdraw);
+	XDestroyWindow(X_Dpy, mc->win);
 
-	XSetInputFocus(X_Dpy, focuswin, focusrevert, CurrentTime);
+	XSetInputFocus(X_Dpy, mc->focuswin, mc->focusrevert, CurrentTime);
 	/* restore if user didn't move */
-	xu_ptr_get(sc->rootwin, &xcur, &ycur);
-	if (xcur == mc.geom.x && ycur == mc.geom.y)
-		xu_ptr_set(sc->rootwin, xsave, ysave);
+	xu_ptr_get(mc->sc->rootwin, &xcur, &ycur);
+	if (xcur == mc->geom.x && ycur == mc->geom.y)
+		xu_ptr_set(mc->sc->rootwin, mc->xsave, mc->ysave);
 
 	XUngrabPointer(X_Dpy, CurrentTime);
 	XUngrabKeyboard(X_Dpy, CurrentTime);
 
-	return mi;
+	if (mi != NULL) {
+		if (mc->done != NULL)
+			(*mc->done)(mi, mc->arg);
+		/* Results made up by the menu are its own to free. */
+		TAILQ_FOREACH(mr, &mc->menuq, entry)
+			if (mr == mi)
+				break;
+		if (mr == NULL)
+			xfree(mi);
+	}
+	menuq_clear(&mc->menuq);
+	xfree(mc);
+
+	/* The input goes back to the menu that was below, if any. */
+	if (menu_open != NULL)
+		(void)menu_grab(menu_open);
 }
 
-static struct menu *
+/*
+ * Feed an event to the open menus; returns 1 if it was used.  Input
+ * belongs to the menu on top, and entering a client must not focus it.
+ */
+int
+menu_event(XEvent *e)
+{
+	struct menu_ctx		*mc;
+	struct menu		*mi = NULL;
+
+	if (menu_open == NULL)
+		return 0;
+
+	for (mc = menu_open; mc != NULL; mc = mc->below)
+		if (e->xany.window == mc->win)
+			break;
+	if (mc == NULL) {
+		switch (e->type) {
+		case KeyPress:
+		case KeyRelease:
+		case ButtonPress:
+		case ButtonRelease:
+		case MotionNotify:
+		case EnterNotify:
+			return 1;
+		default:
+			return 0;
+		}
+	}
+	if (mc != menu_open) {
+		if (e->type == Expose)
+			menu_draw(mc, &mc->menuq, &mc->resultq);
+		return 1;
+	}
+
+	mc->changed = 0;
+	switch (e->type) {
+	case KeyPress:
+		if ((mi = menu_handle_key(e, mc, &mc->menuq,
+		    &mc->resultq)) != NULL)
+			break;
+		/* FALLTHROUGH */
+	case Expose:
+		menu_draw(mc, &mc->menuq, &mc->resultq);
+		if (mc->start != 0)
+			menu_opened(mc);
+		break;
+	case MotionNotify:
+		menu_handle_move(mc, &mc->resultq,
+		    e->xbutton.x, e->xbutton.y);
+		break;
+	case ButtonRelease:
+		mi = menu_handle_release(mc, &mc->resultq,
+		    e->xbutton.x, e->xbutton.y);
+		break;
+	default:
+		break;
+	}
+	if (mi != NULL)
+		menu_close(mc, mi);
+	return 1;
+}
+
+/* First drawn: the time since menu_filter() is the open latency. */
+static void
+menu_opened(struct menu_ctx *mc)
+{
+	unsigned long long	 usec = u_time_usec() - mc->start;
+
+	Stats.menu_opens++;
+	Stats.menu_open_usec += usec;
+	if (usec > Stats.menu_open_max)
+		Stats.menu_open_max = usec;
+	mc->start = 0;
+}
+
+int
+menu_active(void)
+{
+	return (menu_open != NULL);
+}
+
+/*
+ * Drop entries referring to ctx, which is going away, from open menus,
+ * and the result of a menu opened for it.
+ */
+void
+menu_forget(void *ctx)
+{
+	struct menu_ctx	*mc;
+	struct menu	*mi, *mitmp, *mr;
+
+	for (mc = menu_open; mc != NULL; mc = mc->below) {
+		/* Nobody is left to take the result. */
+		if (mc->arg == ctx)
+			mc->done = NULL;
+		TAILQ_FOREACH_SAFE(mi, &mc->menuq, entry, mitmp) {
+			if (mi->ctx != ctx)
+				continue;
+			TAILQ_FOREACH(mr, &mc->resultq, resultentry) {
+				if (mr == mi) {
+					TAILQ_REMOVE(&mc->resultq, mi,
+					    resultentry);
+					break;
+				}
+			}
+			TAILQ_REMOVE(&mc->menuq, mi, entry);
+			xfree(mi);
+			mc->changed = 1;
+		}
+		if (mc->changed) {
+			mc->entry = mc->prev = -1;
+			menu_draw(mc, &mc->menuq, &mc->resultq);
+		}
+	}
+}
+
+/* Open a file menu above mc, which completes mc when it closes. */
+static void
 menu_complete_path(struct menu_ctx *mc)
 {
-	struct screen_ctx	*sc = mc->sc;
-	struct menu		*mi, *mr;
 	struct menu_q		 menuq;
 	int			 mflags = (CWM_MENU_DUMMY);
 
-	mr = xcalloc(1, sizeof(*mr));
-
 	TAILQ_INIT(&menuq);
 
-	if ((mi = menu_filter(sc, &menuq, mc->searchstr, NULL, mflags,
-	    search_match_path, search_print_text)) != NULL) {
-		mr->abort = mi->abort;
-		mr->dummy = mi->dummy;
-		if (mi->text[0] != '\0')
-			snprintf(mr->text, sizeof(mr->text), "%s \"%s\"",
-			    mc->searchstr, mi->text);
-		else if (!mr->abort)
-			strlcpy(mr->text, mc->searchstr, sizeof(mr->text));
-	}
-	
-	menuq_clear(&menuq);
+	menu_filter(mc->sc, &menuq, mc->searchstr, NULL, mflags,
+	    search_match_path, search_print_text, menu_complete_path_done, mc);
+}
+
+static void
+menu_complete_path_done(struct menu *mi, void *arg)
+{
+	struct menu_ctx		*mc = arg;
+	struct menu		*mr;
 
-	return mr;
+	mr = xcalloc(1, sizeof(*mr));
+	mr->abort = mi->abort;
+	mr->dummy = mi->dummy;
+	if (mi->text[0] != '\0')
+		snprintf(mr->text, sizeof(mr->text), "%s \"%s\"",
+		    mc->searchstr, mi->text);
+	else if (!mr->abort)
+		strlcpy(mr->text, mc->searchstr, sizeof(mr->text));
+
+	/* The file menu is off the stack by now. */
+	menu_close(mc, mr);
 }
 
 static struct menu *
@@ -283,8 +441,10 @@ menu_handle_key(XEvent *e, struct menu_ctx *mc, struct menu_q *menuq,
 			 */
 			if ((mc->flags & CWM_MENU_FILE) &&
 			    (strncmp(mc->searchstr, mi->text,
-					strlen(mi->text))) == 0)
-				return menu_complete_path(mc);
+					strlen(mi->text))) == 0) {
+				menu_complete_path(mc);
+				return NULL;
+			}
 
 			/*
 			 * Put common prefix of the results into searchstr
@@ -614,6 +774,6 @@ menuq_clear(struct menu_q *mq)
 
 	while ((mi = TAILQ_FIRST(mq)) != NULL) {
 		TAILQ_REMOVE(mq, mi, entry);
-		free(mi);
+		xfree(mi);
 	}
 }
@@ -0,0 +1,247 @@
+/*
+ * calmwm - the calm window manager
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * $OpenBSD$
+ */
+
+/*
+ * Counters in the Prometheus text exposition format, rewritten every
+ * METRICS_INTERVAL to a file for a local collector to pick up, such as
+ * the textfile collector of node_exporter.  The file is replaced with
+ * rename(2), so a reader never sees it half written.
+ */
+
+#include <sys/types.h>
+#include "queue.h"
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calmwm.h"
+
+#define METRICS_INTERVAL	15000000	/* usec */
+
+static char		*metrics_path;
+static struct timer	 metrics_timer;
+
+static const char *event_names[LASTEvent + 1] = {
+	[KeyPress] = "KeyPress",
+	[KeyRelease] = "KeyRelease",
+	[ButtonPress] = "ButtonPress",
+	[ButtonRelease] = "ButtonRelease",
+	[MotionNotify] = "MotionNotify",
+	[EnterNotify] = "EnterNotify",
+	[LeaveNotify] = "LeaveNotify",
+	[FocusIn] = "FocusIn",
+	[FocusOut] = "FocusOut",
+	[KeymapNotify] = "KeymapNotify",
+	[Expose] = "Expose",
+	[GraphicsExpose] = "GraphicsExpose",
+	[NoExpose] = "NoExpose",
+	[VisibilityNotify] = "VisibilityNotify",
+	[CreateNotify] = "CreateNotify",
+	[DestroyNotify] = "DestroyNotify",
+	[UnmapNotify] = "UnmapNotify",
+	[MapNotify] = "MapNotify",
+	[MapRequest] = "MapRequest",
+	[ReparentNotify] = "ReparentNotify",
+	[ConfigureNotify] = "ConfigureNotify",
+	[ConfigureRequest] = "ConfigureRequest",
+	[GravityNotify] = "GravityNotify",
+	[ResizeRequest] = "ResizeRequest",
+	[CirculateNotify] = "CirculateNotify",
+	[CirculateRequest] = "CirculateRequest",
+	[PropertyNotify] = "PropertyNotify",
+	[SelectionClear] = "SelectionClear",
+	[SelectionRequest] = "SelectionRequest",
+	[SelectionNotify] = "SelectionNotify",
+	[ColormapNotify] = "ColormapNotify",
+	[ClientMessage] = "ClientMessage",
+	[MappingNotify] = "MappingNotify",
+	[GenericEvent] = "GenericEvent",
+	[LASTEvent] = "extension",
+};
+
+static void	 metrics_write(void *);
+
+void
+metrics_init(const char *path)
+{
+	metrics_path = xstrdup(path);
+	metrics_write(NULL);
+}
+
+void
+metrics_close(void)
+{
+	if (metrics_path == NULL)
+		return;
+	timer_del(&metrics_timer);
+	/* Stale numbers are worse than none. */
+	(void)unlink(metrics_path);
+	xfree(metrics_path);
+	metrics_path = NULL;
+}
+
+/* Count an event and the time its handler took. */
+void
+metrics_handler(int type, unsigned long long usec)
+{
+	unsigned long long	 bound = 1;
+	int			 i;
+
+	if (type < 0 || type >= LASTEvent)
+		type = LASTEvent;
+	Stats.events[type]++;
+
+	for (i = 0; i < STATS_NBUCKETS && usec > bound; i++)
+		bound *= 4;
+	Stats.handler_bucket[i]++;
+	Stats.handler_usec += usec;
+}
+
+static void
+metrics_counter(FILE *fp, const char *name, const char *help,
+    unsigned long long val)
+{
+	fprintf(fp, "# HELP cwm_%s %s\n", name, help);
+	fprintf(fp, "# TYPE cwm_%s counter\n", name);
+	fprintf(fp, "cwm_%s %llu\n", name, val);
+}
+
+static void
+metrics_print(FILE *fp)
+{
+	struct screen_ctx	*sc;
+	struct client_ctx	*cc;
+	struct rusage		 ru;
+	unsigned long long	 bound, n;
+	int			 i, nclients;
+
+	fprintf(fp, "# HELP cwm_clients Managed clients.\n");
+	fprintf(fp, "# TYPE cwm_clients gauge\n");
+	TAILQ_FOREACH(sc, &Screenq, entry) {
+		nclients = 0;
+		TAILQ_FOREACH(cc, &sc->clientq, entry)
+			nclients++;
+		fprintf(fp, "cwm_clients{screen=\"%d\"} %d\n", sc->which,
+		    nclients);
+	}
+
+	fprintf(fp, "# HELP cwm_events_total X events handled.\n");
+	fprintf(fp, "# TYPE cwm_events_total counter\n");
+	for (i = 0; i <= LASTEvent; i++) {
+		if (event_names[i] != NULL && Stats.events[i] != 0)
+			fprintf(fp, "cwm_events_total{type=\"%s\"} %lu\n",
+			    event_names[i], Stats.events[i]);
+	}
+
+	fprintf(fp, "# HELP cwm_handler_seconds Time spent handling an "
+	    "event.\n");
+	fprintf(fp, "# TYPE cwm_handler_seconds histogram\n");
+	for (i = 0, n = 0, bound = 1; i < STATS_NBUCKETS; i++, bound *= 4) {
+		n += Stats.handler_bucket[i];
+		fprintf(fp, "cwm_handler_seconds_bucket{le=\"%g\"} %llu\n",
+		    bound / 1e6, n);
+	}
+	n += Stats.handler_bucket[STATS_NBUCKETS];
+	fprintf(fp, "cwm_handler_seconds_bucket{le=\"+Inf\"} %llu\n", n);
+	fprintf(fp, "cwm_handler_seconds_sum %.6f\n", Stats.handler_usec / 1e6);
+	fprintf(fp, "cwm_handler_seconds_count %llu\n", n);
+
+	fprintf(fp, "# HELP cwm_menu_open_seconds Time from opening a menu "
+	    "until it is first drawn.\n");
+	fprintf(fp, "# TYPE cwm_menu_open_seconds summary\n");
+	fprintf(fp, "cwm_menu_open_seconds_sum %.6f\n",
+	    Stats.menu_open_usec / 1e6);
+	fprintf(fp, "cwm_menu_open_seconds_count %lu\n", Stats.menu_opens);
+	fprintf(fp, "# HELP cwm_menu_open_seconds_max Slowest menu open.\n");
+	fprintf(fp, "# TYPE cwm_menu_open_seconds_max gauge\n");
+	fprintf(fp, "cwm_menu_open_seconds_max %.6f\n",
+	    Stats.menu_open_max / 1e6);
+
+	/* The sequence number of the next request is a running count. */
+	metrics_counter(fp, "x_requests_total", "X requests issued.",
+	    NextRequest(X_Dpy) - 1);
+	metrics_counter(fp, "xsync_total", "XSync round trips.", Stats.xsync);
+	metrics_counter(fp, "spawns_total", "Programs started.", Stats.spawns);
+	metrics_counter(fp, "allocs_total", "Allocations by the xmalloc "
+	    "wrappers.", Stats.allocs);
+	fprintf(fp, "# HELP cwm_alloc_live_bytes Bytes allocated and not "
+	    "yet freed, with cwm -a.\n");
+	fprintf(fp, "# TYPE cwm_alloc_live_bytes gauge\n");
+	for (i = 0; i < XM_NTAGS; i++)
+		fprintf(fp, "cwm_alloc_live_bytes{subsystem=\"%s\"} %llu\n",
+		    xm_tag_name(i), Stats.mem[i].live);
+	fprintf(fp, "# HELP cwm_alloc_peak_bytes High-water mark of "
+	    "cwm_alloc_live_bytes.\n");
+	fprintf(fp, "# TYPE cwm_alloc_peak_bytes gauge\n");
+	for (i = 0; i < XM_NTAGS; i++)
+		fprintf(fp, "cwm_alloc_peak_bytes{subsystem=\"%s\"} %llu\n",
+		    xm_tag_name(i), Stats.mem[i].peak);
+	metrics_counter(fp, "group_switches_total", "Group switches.",
+	    Stats.group_switch);
+	metrics_counter(fp, "configure_requests_total", "ConfigureRequest "
+	    "events.", Stats.configure_requests);
+	metrics_counter(fp, "ctl_commands_total", "Control socket commands.",
+	    Stats.ctl_commands);
+
+	if (getrusage(RUSAGE_SELF, &ru) == 0) {
+		fprintf(fp, "# HELP cwm_max_rss_bytes Peak resident set "
+		    "size.\n");
+		fprintf(fp, "# TYPE cwm_max_rss_bytes gauge\n");
+		fprintf(fp, "cwm_max_rss_bytes %llu\n",
+		    (unsigned long long)ru.ru_maxrss * 1024);
+	}
+}
+
+static void
+metrics_write(void *arg)
+{
+	FILE	*fp;
+	char	*tmp;
+	int	 fd;
+
+	timer_add(&metrics_timer, METRICS_INTERVAL, metrics_write, NULL);
+
+	xasprintf(&tmp, "%s.XXXXXXXXXX", metrics_path);
+	if ((fd = mkstemp(tmp)) == -1) {
+		warn("%s", tmp);
+		xfree(tmp);
+		return;
+	}
+	if ((fp = fdopen(fd, "w")) == NULL) {
+		warn("%s", tmp);
+		close(fd);
+		(void)unlink(tmp);
+		xfree(tmp);
+		return;
+	}
+	(void)fchmod(fd, 0644);
+	metrics_print(fp);
+	if (fclose(fp) == EOF || rename(tmp, metrics_path) == -1) {
+		warn("%s", metrics_path);
+		(void)unlink(tmp);
+	}
+	xfree(tmp);
+}
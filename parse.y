@@ -74,7 +74,7 @@ typedef struct {
 %token	FONTNAME STICKY GAP
 %token	AUTOGROUP COMMAND IGNORE WM
 %token	YES NO BORDERWIDTH MOVEAMOUNT HTILE VTILE
-%token	COLOR SNAPDIST
+%token	COLOR SNAPDIST CONFIGURERATE PLACEMENT
 %token	ACTIVEBORDER INACTIVEBORDER URGENCYBORDER
 %token	GROUPBORDER UNGROUPBORDER
 %token	MENUBG MENUFG
@@ -95,13 +95,13 @@ grammar		: /* empty */
 
 string		: string STRING			{
 			if (asprintf(&$$, "%s %s", $1, $2) == -1) {
-				free($1);
-				free($2);
+				xfree($1);
+				xfree($2);
 				yyerror("string: asprintf");
 				YYERROR;
 			}
-			free($1);
-			free($2);
+			xfree($1);
+			xfree($2);
 		}
 		| STRING
 		;
@@ -122,7 +122,7 @@ yesno		: YES				{ $$ = 1; }
 		;
 
 main		: FONTNAME STRING		{
-			free(conf->font);
+			xfree(conf->font);
 			conf->font = $2;
 		}
 		| STICKY yesno {
@@ -163,51 +163,70 @@ main		: FONTNAME STRING		{
 			}
 			conf->snapdist = $2;
 		}
+		| PLACEMENT STRING {
+			if (strcmp($2, "pointer") == 0)
+				conf->placement = PLACEMENT_POINTER;
+			else if (strcmp($2, "smart") == 0)
+				conf->placement = PLACEMENT_SMART;
+			else {
+				yyerror("invalid placement: %s", $2);
+				xfree($2);
+				YYERROR;
+			}
+			xfree($2);
+		}
+		| CONFIGURERATE NUMBER {
+			if ($2 < 0 || $2 > 1000000) {
+				yyerror("invalid configurerate");
+				YYERROR;
+			}
+			conf->configurerate = $2;
+		}
 		| COMMAND STRING string		{
 			if (strlen($3) >= PATH_MAX) {
 				yyerror("%s command path too long", $2);
-				free($2);
-				free($3);
+				xfree($2);
+				xfree($3);
 				YYERROR;
 			}
 			conf_cmd_add(conf, $2, $3);
-			free($2);
-			free($3);
+			xfree($2);
+			xfree($3);
 		}
 		| WM STRING string	{
 			if (strlen($3) >= PATH_MAX) {
 				yyerror("%s wm path too long", $2);
-				free($2);
-				free($3);
+				xfree($2);
+				xfree($3);
 				YYERROR;
 			}
 			conf_wm_add(conf, $2, $3);
-			free($2);
-			free($3);
+			xfree($2);
+			xfree($3);
 		}
 		| AUTOGROUP NUMBER STRING	{
 			if ($2 < 0 || $2 > 9) {
 				yyerror("invalid autogroup");
-				free($3);
+				xfree($3);
 				YYERROR;
 			}
 			conf_autogroup(conf, $2, NULL, $3);
-			free($3);
+			xfree($3);
 		}
 		| AUTOGROUP NUMBER STRING ',' STRING {
 			if ($2 < 0 || $2 > 9) {
 				yyerror("invalid autogroup");
-				free($3);
-				free($5);
+				xfree($3);
+				xfree($5);
 				YYERROR;
 			}
 			conf_autogroup(conf, $2, $3, $5);
-			free($3);
-			free($5);
+			xfree($3);
+			xfree($5);
 		}
 		| IGNORE STRING {
 			conf_ignore(conf, $2);
-			free($2);
+			xfree($2);
 		}
 		| GAP NUMBER NUMBER NUMBER NUMBER {
 			if ($2 < 0 || $2 > INT_MAX ||
@@ -225,38 +244,38 @@ main		: FONTNAME STRING		{
 		| BINDKEY numberstring string {
 			if (!conf_bind_key(conf, $2, $3)) {
 				yyerror("invalid bind-key: %s %s", $2, $3);
-				free($2);
-				free($3);
+				xfree($2);
+				xfree($3);
 				YYERROR;
 			}
-			free($2);
-			free($3);
+			xfree($2);
+			xfree($3);
 		}
 		| UNBINDKEY numberstring {
 			if (!conf_bind_key(conf, $2, NULL)) {
 				yyerror("invalid unbind-key: %s", $2);
-				free($2);
+				xfree($2);
 				YYERROR;
 			}
-			free($2);
+			xfree($2);
 		}
 		| BINDMOUSE numberstring string {
 			if (!conf_bind_mouse(conf, $2, $3)) {
 				yyerror("invalid bind-mouse: %s %s", $2, $3);
-				free($2);
-				free($3);
+				xfree($2);
+				xfree($3);
 				YYERROR;
 			}
-			free($2);
-			free($3);
+			xfree($2);
+			xfree($3);
 		}
 		| UNBINDMOUSE numberstring {
 			if (!conf_bind_mouse(conf, $2, NULL)) {
 				yyerror("invalid unbind-mouse: %s", $2);
-				free($2);
+				xfree($2);
 				YYERROR;
 			}
-			free($2);
+			xfree($2);
 		}
 		;
 
@@ -264,39 +283,39 @@ color		: COLOR colors
 		;
 
 colors		: ACTIVEBORDER STRING {
-			free(conf->color[CWM_COLOR_BORDER_ACTIVE]);
+			xfree(conf->color[CWM_COLOR_BORDER_ACTIVE]);
 			conf->color[CWM_COLOR_BORDER_ACTIVE] = $2;
 		}
 		| INACTIVEBORDER STRING {
-			free(conf->color[CWM_COLOR_BORDER_INACTIVE]);
+			xfree(conf->color[CWM_COLOR_BORDER_INACTIVE]);
 			conf->color[CWM_COLOR_BORDER_INACTIVE] = $2;
 		}
 		| URGENCYBORDER STRING {
-			free(conf->color[CWM_COLOR_BORDER_URGENCY]);
+			xfree(conf->color[CWM_COLOR_BORDER_URGENCY]);
 			conf->color[CWM_COLOR_BORDER_URGENCY] = $2;
 		}
 		| GROUPBORDER STRING {
-			free(conf->color[CWM_COLOR_BORDER_GROUP]);
+			xfree(conf->color[CWM_COLOR_BORDER_GROUP]);
 			conf->color[CWM_COLOR_BORDER_GROUP] = $2;
 		}
 		| UNGROUPBORDER STRING {
-			free(conf->color[CWM_COLOR_BORDER_UNGROUP]);
+			xfree(conf->color[CWM_COLOR_BORDER_UNGROUP]);
 			conf->color[CWM_COLOR_BORDER_UNGROUP] = $2;
 		}
 		| MENUBG STRING {
-			free(conf->color[CWM_COLOR_MENU_BG]);
+			xfree(conf->color[CWM_COLOR_MENU_BG]);
 			conf->color[CWM_COLOR_MENU_BG] = $2;
 		}
 		| MENUFG STRING {
-			free(conf->color[CWM_COLOR_MENU_FG]);
+			xfree(conf->color[CWM_COLOR_MENU_FG]);
 			conf->color[CWM_COLOR_MENU_FG] = $2;
 		}
 		| FONTCOLOR STRING {
-			free(conf->color[CWM_COLOR_MENU_FONT]);
+			xfree(conf->color[CWM_COLOR_MENU_FONT]);
 			conf->color[CWM_COLOR_MENU_FONT] = $2;
 		}
 		| FONTSELCOLOR STRING {
-			free(conf->color[CWM_COLOR_MENU_FONT_SEL]);
+			xfree(conf->color[CWM_COLOR_MENU_FONT_SEL]);
 			conf->color[CWM_COLOR_MENU_FONT_SEL] = $2;
 		}
 		;
@@ -339,6 +358,7 @@ lookup(char *s)
 		{ "borderwidth",	BORDERWIDTH},
 		{ "color",		COLOR},
 		{ "command",		COMMAND},
+		{ "configurerate",	CONFIGURERATE},
 		{ "font",		FONTCOLOR},
 		{ "fontname",		FONTNAME},
 		{ "gap",		GAP},
@@ -350,6 +370,7 @@ lookup(char *s)
 		{ "menufg",		MENUFG},
 		{ "moveamount",		MOVEAMOUNT},
 		{ "no",			NO},
+		{ "placement",		PLACEMENT},
 		{ "selfont", 		FONTSELCOLOR},
 		{ "snapdist",		SNAPDIST},
 		{ "sticky",		STICKY},
@@ -609,8 +630,8 @@ popfile(void)
 
 	TAILQ_REMOVE(&files, file, entry);
 	fclose(file->stream);
-	free(file->name);
-	free(file);
+	xfree(file->name);
+	xfree(file);
 	file = prev;
 	return (file ? 0 : EOF);
 }
@@ -0,0 +1,223 @@
+/*
+ * calmwm - the calm window manager
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * $OpenBSD$
+ */
+
+/*
+ * Smart placement: put a new window where it overlaps the fewest
+ * visible windows, the topmost, then leftmost such spot in the area.
+ *
+ * A window of outer size W x H overlaps another at (ox, oy, ow, oh)
+ * exactly when its top-left corner lies in [ox - W + 1, ox + ow) x
+ * [oy - H + 1, oy + oh).  A line sweeping down over these rectangles
+ * keeps, in a segment tree over the compressed x coordinates, how many
+ * of them cover each x; the least covered x of the first row where the
+ * minimum is reached is the answer.  This takes O(n log n) for n
+ * windows.
+ */
+
+#include <sys/types.h>
+#include "queue.h"
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calmwm.h"
+
+struct place_ev {
+	int		 y;
+	int		 x0, x1;	/* [x0, x1) */
+	int		 v;		/* +1 enters, -1 leaves */
+};
+
+static int		*xs;		/* compressed x coordinates */
+static int		 nxs;
+static int		*tmin, *tadd;	/* segment tree over [xs[i], xs[i+1]) */
+
+static int	 place_intcmp(const void *, const void *);
+static int	 place_evcmp(const void *, const void *);
+static int	 place_index(int);
+static void	 place_add(int, int, int, int, int, int);
+static int	 place_first(void);
+
+static int
+place_intcmp(const void *a, const void *b)
+{
+	int	 x = *(const int *)a, y = *(const int *)b;
+
+	return (x > y) - (x < y);
+}
+
+static int
+place_evcmp(const void *a, const void *b)
+{
+	const struct place_ev	*ea = a, *eb = b;
+
+	return (ea->y > eb->y) - (ea->y < eb->y);
+}
+
+/* Leaf starting at coordinate x, which is one of xs. */
+static int
+place_index(int x)
+{
+	int	*p;
+
+	p = bsearch(&x, xs, nxs, sizeof(*xs), place_intcmp);
+	return p - xs;
+}
+
+/* Add v to leaves [a, b) below node, which spans leaves [lo, hi). */
+static void
+place_add(int node, int lo, int hi, int a, int b, int v)
+{
+	int	 mid;
+
+	if (b <= lo || hi <= a)
+		return;
+	if (a <= lo && hi <= b) {
+		tmin[node] += v;
+		tadd[node] += v;
+		return;
+	}
+	mid = (lo + hi) / 2;
+	place_add(2 * node, lo, mid, a, b, v);
+	place_add(2 * node + 1, mid, hi, a, b, v);
+	tmin[node] = MIN(tmin[2 * node], tmin[2 * node + 1]) + tadd[node];
+}
+
+/* Leftmost leaf holding the minimum. */
+static int
+place_first(void)
+{
+	int	 node = 1, lo = 0, hi = nxs - 1, mid, want = tmin[1];
+
+	while (hi - lo > 1) {
+		want -= tadd[node];
+		mid = (lo + hi) / 2;
+		if (tmin[2 * node] == want) {
+			node = 2 * node;
+			hi = mid;
+		} else {
+			node = 2 * node + 1;
+			lo = mid;
+		}
+	}
+	return lo;
+}
+
+/*
+ * Place cc in area, which has the gap applied.  Returns 0 and leaves
+ * cc alone if it does not fit, for the caller to fall back.
+ */
+int
+place_smart(struct client_ctx *cc, struct geom area)
+{
+	struct screen_ctx	*sc = cc->sc;
+	struct client_ctx	*ci;
+	struct place_ev		*ev;
+	int			 w, h, xlo, xhi, ylo, yhi, x0, x1, y0, y1;
+	int			 i, j, left, n = 0, nev = 0;
+	int			 best = INT_MAX, bx = 0, by = 0;
+
+	w = cc->geom.w + cc->bwidth * 2;
+	h = cc->geom.h + cc->bwidth * 2;
+	/* Top-left corners that keep the window in the area. */
+	xlo = area.x;
+	xhi = area.x + area.w - w + 1;
+	ylo = area.y;
+	yhi = area.y + area.h - h + 1;
+	if (xhi <= xlo || yhi <= ylo)
+		return 0;
+
+	TAILQ_FOREACH(ci, &sc->clientq, entry)
+		n++;
+	ev = xreallocarray(NULL, 2 * n + 1, sizeof(*ev));
+	xs = xreallocarray(NULL, 2 * n + 2, sizeof(*xs));
+	nxs = 0;
+	xs[nxs++] = xlo;
+	xs[nxs++] = xhi;
+
+	TAILQ_FOREACH(ci, &sc->clientq, entry) {
+		if (ci == cc || (ci->flags & CLIENT_HIDDEN))
+			continue;
+		x0 = MAX(ci->geom.x - w + 1, xlo);
+		x1 = MIN(ci->geom.x + ci->geom.w + ci->bwidth * 2, xhi);
+		y0 = MAX(ci->geom.y - h + 1, ylo);
+		y1 = MIN(ci->geom.y + ci->geom.h + ci->bwidth * 2, yhi);
+		if (x0 >= x1 || y0 >= y1)
+			continue;
+		xs[nxs++] = x0;
+		xs[nxs++] = x1;
+		ev[nev].y = y0;
+		ev[nev].x0 = x0;
+		ev[nev].x1 = x1;
+		ev[nev++].v = 1;
+		ev[nev].y = y1;
+		ev[nev].x0 = x0;
+		ev[nev].x1 = x1;
+		ev[nev++].v = -1;
+	}
+
+	qsort(xs, nxs, sizeof(*xs), place_intcmp);
+	for (i = 1, j = 1; i < nxs; i++)
+		if (xs[i] != xs[j - 1])
+			xs[j++] = xs[i];
+	nxs = j;
+	qsort(ev, nev, sizeof(*ev), place_evcmp);
+
+	/* Leaves are the nxs - 1 intervals between the coordinates. */
+	tmin = xcalloc(4 * nxs, sizeof(*tmin));
+	tadd = xcalloc(4 * nxs, sizeof(*tadd));
+
+	if (nev == 0 || ev[0].y > ylo) {
+		/* Nothing covers the top row. */
+		best = 0;
+		bx = xlo;
+		by = ylo;
+	}
+	/* Rows to check: the top, and wherever a window was left behind. */
+	for (i = 0; i < nev && best > 0;) {
+		if ((y0 = ev[i].y) >= yhi)
+			break;
+		left = (y0 == ylo);
+		for (; i < nev && ev[i].y == y0; i++) {
+			place_add(1, 0, nxs - 1, place_index(ev[i].x0),
+			    place_index(ev[i].x1), ev[i].v);
+			if (ev[i].v < 0)
+				left = 1;
+		}
+		if (left && tmin[1] < best) {
+			best = tmin[1];
+			bx = xs[place_first()];
+			by = y0;
+		}
+	}
+
+	xfree(tmin);
+	xfree(tadd);
+	xfree(xs);
+	xfree(ev);
+
+	LOG_DEBUG1("window 0x%lx: %d,%d overlapping %d", cc->win, bx, by, best);
+	cc->geom.x = bx;
+	cc->geom.y = by;
+	return 1;
+}
@@ -32,8 +32,32 @@
 
 #include "calmwm.h"
 
+#define RANDR_DELAY	100000	/* usec */
+#define SNAPSHOTS	8	/* output configurations remembered */
+
+/* Where the clients were while a set of outputs was connected. */
+struct snapshot {
+	TAILQ_ENTRY(snapshot)	 entry;
+	char			*outputs;
+	int			 nents;
+	struct {
+		Window		 win;
+		struct geom	 geom;
+		struct geom	 savegeom;
+		int		 flags;
+	}			*ents;
+};
+
 static struct geom screen_apply_gap(struct screen_ctx *, struct geom);
 static void screen_scan(struct screen_ctx *);
+static void screen_randr(void *);
+static void screen_region_add(struct screen_ctx *, struct region_q *, int,
+    int, int, int, int);
+static void screen_outputs(struct screen_ctx *, char **, int);
+static int screen_outputs_cmp(const void *, const void *);
+static struct snapshot *screen_snapshot(struct screen_ctx *);
+static void screen_snapshot_free(struct snapshot *);
+static void screen_snapshot_restore(struct screen_ctx *);
 
 void
 screen_init(int which)
@@ -41,10 +65,11 @@ screen_init(int which)
 	struct screen_ctx	*sc;
 	XSetWindowAttributes	 attr;
 
-	sc = xmalloc(sizeof(*sc));
+	sc = xcalloc(1, sizeof(*sc));
 
 	TAILQ_INIT(&sc->clientq);
 	TAILQ_INIT(&sc->regionq);
+	TAILQ_INIT(&sc->snapq);
 	TAILQ_INIT(&sc->groupq);
 
 	sc->which = which;
@@ -81,7 +106,7 @@ screen_init(int which)
 
 	TAILQ_INSERT_TAIL(&Screenq, sc, entry);
 
-	XSync(X_Dpy, False);
+	xu_sync(False);
 }
 
 static void
@@ -172,9 +197,26 @@ screen_area(struct screen_ctx *sc, int x, int y, int apply_gap)
 	return area;
 }
 
+static void
+screen_region_add(struct screen_ctx *sc, struct region_q *rq, int num,
+    int x, int y, int w, int h)
+{
+	struct region_ctx	*rc;
+
+	rc = xmalloc(sizeof(*rc));
+	rc->num = num;
+	rc->view.x = x;
+	rc->view.y = y;
+	rc->view.w = w;
+	rc->view.h = h;
+	rc->work = screen_apply_gap(sc, rc->view);
+	TAILQ_INSERT_TAIL(rq, rc, entry);
+}
+
 void
 screen_update_geometry(struct screen_ctx *sc)
 {
+	struct region_q		 regionq;
 	struct region_ctx	*rc;
 
 	sc->view.x = 0;
@@ -183,46 +225,88 @@ screen_update_geometry(struct screen_ctx *sc)
 	sc->view.h = DisplayHeight(X_Dpy, sc->which);
 	sc->work = screen_apply_gap(sc, sc->view);
 
-	while ((rc = TAILQ_FIRST(&sc->regionq)) != NULL) {
-		TAILQ_REMOVE(&sc->regionq, rc, entry);
-		free(rc);
-	}
-
+	/* Build the new regions first, then swap them in. */
+	TAILQ_INIT(&regionq);
+	xfree(sc->outputs);
+	sc->outputs = NULL;
+
+#if RANDR_MAJOR > 1 || RANDR_MINOR >= 5
+	if (Conf.xrandr_monitors) {
+		XRRMonitorInfo *mi;
+		Atom *atoms;
+		char **names;
+		int i, n;
+
+		/* One request, answered from the server's current state. */
+		mi = XRRGetMonitors(X_Dpy, sc->rootwin, True, &n);
+		if (mi != NULL && n > 0) {
+			atoms = xreallocarray(NULL, n, sizeof(*atoms));
+			names = xcalloc(n, sizeof(*names));
+			for (i = 0; i < n; i++) {
+				screen_region_add(sc, &regionq, i, mi[i].x,
+				    mi[i].y, mi[i].width, mi[i].height);
+				atoms[i] = mi[i].name;
+			}
+			/* Monitors are named after their outputs. */
+			if (XGetAtomNames(X_Dpy, atoms, n, names))
+				screen_outputs(sc, names, n);
+			for (i = 0; i < n; i++)
+				if (names[i] != NULL)
+					XFree(names[i]);
+			xfree(names);
+			xfree(atoms);
+		}
+		if (mi != NULL)
+			XRRFreeMonitors(mi);
+	} else
+#endif
 	if (Conf.xrandr) {
 		XRRScreenResources *sr;
 		XRRCrtcInfo *ci;
-		int i;
+		XRROutputInfo *oi;
+		char **names = NULL;
+		int i, j, n = 0;
 
-		sr = XRRGetScreenResources(X_Dpy, sc->rootwin);
-		for (i = 0, ci = NULL; i < sr->ncrtc; i++) {
+		/* Current resources do not make the server probe outputs. */
+		sr = XRRGetScreenResourcesCurrent(X_Dpy, sc->rootwin);
+		for (i = 0; sr != NULL && i < sr->ncrtc; i++) {
 			ci = XRRGetCrtcInfo(X_Dpy, sr, sr->crtcs[i]);
 			if (ci == NULL)
 				continue;
-			if (ci->noutput == 0) {
-				XRRFreeCrtcInfo(ci);
-				continue;
+			if (ci->noutput != 0)
+				screen_region_add(sc, &regionq, i, ci->x, ci->y,
+				    ci->width, ci->height);
+			for (j = 0; j < ci->noutput; j++) {
+				oi = XRRGetOutputInfo(X_Dpy, sr,
+				    ci->outputs[j]);
+				if (oi == NULL)
+					continue;
+				names = xreallocarray(names, n + 1,
+				    sizeof(*names));
+				names[n++] = xstrdup(oi->name);
+				XRRFreeOutputInfo(oi);
 			}
-
-			rc = xmalloc(sizeof(*rc));
-			rc->num = i;
-			rc->view.x = ci->x;
-			rc->view.y = ci->y;
-			rc->view.w = ci->width;
-			rc->view.h = ci->height;
-			rc->work = screen_apply_gap(sc, rc->view);
-			TAILQ_INSERT_TAIL(&sc->regionq, rc, entry);
-
 			XRRFreeCrtcInfo(ci);
 		}
-		XRRFreeScreenResources(sr);
-	} else {
-		rc = xmalloc(sizeof(*rc));
-		rc->num = 0;
-		rc->view.x = 0;
-		rc->view.y = 0;
-		rc->view.w = DisplayWidth(X_Dpy, sc->which);
-		rc->view.h = DisplayHeight(X_Dpy, sc->which);
-		rc->work = screen_apply_gap(sc, rc->view);
+		if (sr != NULL)
+			XRRFreeScreenResources(sr);
+		if (n > 0)
+			screen_outputs(sc, names, n);
+		for (i = 0; i < n; i++)
+			xfree(names[i]);
+		xfree(names);
+	}
+	if (TAILQ_EMPTY(&regionq))
+		screen_region_add(sc, &regionq, 0, 0, 0,
+		    DisplayWidth(X_Dpy, sc->which),
+		    DisplayHeight(X_Dpy, sc->which));
+
+	while ((rc = TAILQ_FIRST(&sc->regionq)) != NULL) {
+		TAILQ_REMOVE(&sc->regionq, rc, entry);
+		xfree(rc);
+	}
+	while ((rc = TAILQ_FIRST(&regionq)) != NULL) {
+		TAILQ_REMOVE(&regionq, rc, entry);
 		TAILQ_INSERT_TAIL(&sc->regionq, rc, entry);
 	}
 
@@ -231,6 +315,149 @@ screen_update_geometry(struct screen_ctx *sc)
 	xu_ewmh_net_workarea(sc);
 }
 
+static int
+screen_outputs_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* Name the set of connected outputs, in an order that does not vary. */
+static void
+screen_outputs(struct screen_ctx *sc, char **names, int n)
+{
+	size_t	 len = 0;
+	int	 i;
+
+	qsort(names, n, sizeof(*names), screen_outputs_cmp);
+	for (i = 0; i < n; i++)
+		len += strlen(names[i]) + 1;
+
+	xfree(sc->outputs);
+	sc->outputs = xmalloc(len);
+	sc->outputs[0] = '\0';
+	for (i = 0; i < n; i++) {
+		if (i > 0)
+			(void)strlcat(sc->outputs, ",", len);
+		(void)strlcat(sc->outputs, names[i], len);
+	}
+}
+
+static struct snapshot *
+screen_snapshot(struct screen_ctx *sc)
+{
+	struct snapshot		*snap;
+	struct client_ctx	*cc;
+	int			 n = 0;
+
+	if (sc->outputs == NULL)
+		return NULL;
+
+	snap = xcalloc(1, sizeof(*snap));
+	snap->outputs = xstrdup(sc->outputs);
+	TAILQ_FOREACH(cc, &sc->clientq, entry)
+		n++;
+	if (n == 0)
+		return snap;
+	snap->ents = xcalloc(n, sizeof(*snap->ents));
+	TAILQ_FOREACH(cc, &sc->clientq, entry) {
+		/* Full screen clients follow the screen anyway. */
+		if (cc->flags & CLIENT_FULLSCREEN)
+			continue;
+		snap->ents[snap->nents].win = cc->win;
+		snap->ents[snap->nents].geom = cc->geom;
+		snap->ents[snap->nents].savegeom = cc->savegeom;
+		snap->ents[snap->nents].flags = cc->flags & CLIENT_MAXFLAGS;
+		snap->nents++;
+	}
+	return snap;
+}
+
+static void
+screen_snapshot_free(struct snapshot *snap)
+{
+	xfree(snap->outputs);
+	xfree(snap->ents);
+	xfree(snap);
+}
+
+/* Put the clients back where they were the last time. */
+static void
+screen_snapshot_restore(struct screen_ctx *sc)
+{
+	struct snapshot		*snap;
+	struct client_ctx	*cc;
+	int			 i;
+
+	TAILQ_FOREACH(snap, &sc->snapq, entry) {
+		if (strcmp(snap->outputs, sc->outputs) == 0)
+			break;
+	}
+	if (snap == NULL)
+		return;
+
+	LOG_DEBUG1("%s: %d clients", snap->outputs, snap->nents);
+	for (i = 0; i < snap->nents; i++) {
+		if ((cc = client_find(snap->ents[i].win)) == NULL ||
+		    cc->sc != sc || (cc->flags & CLIENT_FULLSCREEN))
+			continue;
+		cc->geom = snap->ents[i].geom;
+		cc->savegeom = snap->ents[i].savegeom;
+		if ((cc->flags & CLIENT_MAXFLAGS) != snap->ents[i].flags) {
+			cc->flags &= ~CLIENT_MAXFLAGS;
+			cc->flags |= snap->ents[i].flags;
+			xu_ewmh_set_net_wm_state(cc);
+		}
+		client_resize(cc, 0);
+	}
+}
+
+static void
+screen_randr(void *arg)
+{
+	struct screen_ctx	*sc = arg;
+	struct snapshot		*snap, *old;
+	int			 n = 0;
+
+	snap = screen_snapshot(sc);
+	screen_update_geometry(sc);
+
+	if (snap != NULL && sc->outputs != NULL &&
+	    strcmp(snap->outputs, sc->outputs) != 0) {
+		/* Remember the configuration being left, most recent first. */
+		TAILQ_FOREACH(old, &sc->snapq, entry) {
+			if (strcmp(old->outputs, snap->outputs) == 0) {
+				TAILQ_REMOVE(&sc->snapq, old, entry);
+				screen_snapshot_free(old);
+				break;
+			}
+		}
+		TAILQ_INSERT_HEAD(&sc->snapq, snap, entry);
+		TAILQ_FOREACH(old, &sc->snapq, entry)
+			n++;
+		if (n > SNAPSHOTS) {
+			old = TAILQ_LAST(&sc->snapq, snapshot_q);
+			TAILQ_REMOVE(&sc->snapq, old, entry);
+			screen_snapshot_free(old);
+		}
+		screen_snapshot_restore(sc);
+	} else if (snap != NULL)
+		screen_snapshot_free(snap);
+
+	layout_mark_all(sc);
+	screen_assert_clients_within(sc);
+}
+
+/*
+ * Docking sends a burst of screen changes; refresh the geometry once,
+ * after they stopped coming for RANDR_DELAY.
+ */
+void
+screen_randr_defer(struct screen_ctx *sc)
+{
+	timer_del(&sc->randr);
+	timer_add(&sc->randr, RANDR_DELAY, screen_randr, sc);
+}
+
 static struct geom
 screen_apply_gap(struct screen_ctx *sc, struct geom geom)
 {
@@ -303,5 +530,5 @@ screen_prop_win_draw(struct screen_ctx *sc, const char *fmt, ...)
 	    sc->xftfont, 0, sc->xftfont->ascent + 1,
 	    (const FcChar8*)text, strlen(text));
 
-	free(text);
+	xfree(text);
 }
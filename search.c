@@ -154,7 +154,7 @@ search_match_group(struct menu_q *menuq, struct menu_q *resultq, char *search)
 		xasprintf(&s, "%d %s", gc->num, gc->name);
 		if (match_substr(search, s, 0))
 			TAILQ_INSERT_TAIL(resultq, mi, resultentry);
-		free(s);
+		xfree(s);
 	}
 }
 
@@ -177,7 +177,7 @@ match_path_type(struct menu_q *resultq, char *search, int flag)
 		TAILQ_INSERT_TAIL(resultq, mi, resultentry);
 	}
 	globfree(&g);
-	free(pattern);
+	xfree(pattern);
 }
 
 void
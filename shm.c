@@ -0,0 +1,234 @@
+/*
+ * calmwm - the calm window manager
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * $OpenBSD$
+ */
+
+/*
+ * Window state in shared memory, see cwmstate.h for the layout.
+ * Clients occupy the first nclients slots; a client going away has
+ * its slot filled with the last one.  Each update is one write section
+ * of the sequence lock.
+ */
+
+#include <sys/types.h>
+#include "queue.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calmwm.h"
+#include "cwmstate.h"
+
+static struct cwm_state		*shm;
+static char			*shm_name;
+/* Client in each slot, to fix up its slot when it is moved. */
+static struct client_ctx	*shm_cc[CWM_STATE_NCLIENTS];
+static int			 shm_depth;
+
+static void	 shm_fill(struct client_ctx *);
+
+/*
+ * Updates between shm_begin() and shm_end() are seen by readers as one;
+ * pairs nest, and only the outermost one moves the sequence number.
+ */
+void
+shm_begin(void)
+{
+	if (shm == NULL || shm_depth++ > 0)
+		return;
+	shm->seq++;
+	__sync_synchronize();
+}
+
+void
+shm_end(void)
+{
+	if (shm == NULL || --shm_depth > 0)
+		return;
+	__sync_synchronize();
+	shm->seq++;
+}
+
+void
+shm_init(const char *name)
+{
+	struct screen_ctx	*sc;
+	struct client_ctx	*cc;
+	int			 fd;
+
+	if ((fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC,
+	    S_IRUSR | S_IWUSR)) == -1)
+		err(1, "%s", name);
+	if (ftruncate(fd, sizeof(*shm)) == -1)
+		err(1, "%s", name);
+	shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED,
+	    fd, 0);
+	if (shm == MAP_FAILED)
+		err(1, "mmap");
+	close(fd);
+
+	shm->magic = CWM_STATE_MAGIC;
+	shm->version = CWM_STATE_VERSION;
+	shm_name = xstrdup(name);
+	setenv("CWM_SHM", shm_name, 1);
+
+	/* Clients managed so far. */
+	TAILQ_FOREACH(sc, &Screenq, entry) {
+		shm_groups(sc);
+		if (sc->group_active != NULL)
+			shm_group(sc->group_active->num);
+		TAILQ_FOREACH(cc, &sc->clientq, entry) {
+			shm_client(cc);
+			if (cc->flags & CLIENT_ACTIVE)
+				shm_active(cc->win);
+		}
+	}
+}
+
+void
+shm_close(void)
+{
+	if (shm == NULL)
+		return;
+	munmap(shm, sizeof(*shm));
+	shm = NULL;
+	shm_unlink(shm_name);
+	xfree(shm_name);
+	shm_name = NULL;
+}
+
+static void
+shm_fill(struct client_ctx *cc)
+{
+	struct cwm_state_client	*sl = &shm->client[cc->shmslot - 1];
+
+	sl->window = cc->win;
+	sl->screen = cc->sc->which;
+	sl->group = (cc->gc != NULL) ? cc->gc->num : 0;
+	sl->flags = 0;
+	if (cc->flags & CLIENT_HIDDEN)
+		sl->flags |= CWM_STATE_HIDDEN;
+	if (cc->flags & CLIENT_URGENCY)
+		sl->flags |= CWM_STATE_URGENT;
+	if (cc->flags & CLIENT_STICKY)
+		sl->flags |= CWM_STATE_STICKY;
+	if (cc->flags & CLIENT_FULLSCREEN)
+		sl->flags |= CWM_STATE_FULLSCREEN;
+	if (cc->flags & CLIENT_MAXIMIZED)
+		sl->flags |= CWM_STATE_MAXIMIZED;
+	sl->x = cc->geom.x;
+	sl->y = cc->geom.y;
+	sl->w = cc->geom.w;
+	sl->h = cc->geom.h;
+	(void)strlcpy(sl->class, (cc->res_class != NULL) ? cc->res_class : "",
+	    sizeof(sl->class));
+	sl->title = (char *)shm->title[cc->shmslot - 1] - (char *)shm;
+	(void)strlcpy(shm->title[cc->shmslot - 1],
+	    (cc->name != NULL) ? cc->name : "", CWM_STATE_TITLELEN);
+}
+
+/* Publish a client, taking a slot for it if it has none yet. */
+void
+shm_client(struct client_ctx *cc)
+{
+	if (shm == NULL)
+		return;
+	if (cc->shmslot == 0) {
+		if (shm->nclients == CWM_STATE_NCLIENTS) {
+			shm_begin();
+			shm->truncated = 1;
+			shm_end();
+			return;
+		}
+		shm_cc[shm->nclients] = cc;
+		cc->shmslot = shm->nclients + 1;
+		shm_begin();
+		shm_fill(cc);
+		shm->nclients++;
+		shm_end();
+		return;
+	}
+	shm_begin();
+	shm_fill(cc);
+	shm_end();
+}
+
+void
+shm_client_remove(struct client_ctx *cc)
+{
+	struct client_ctx	*last;
+	int			 i;
+
+	if (shm == NULL || cc->shmslot == 0)
+		return;
+	i = cc->shmslot - 1;
+	last = shm_cc[shm->nclients - 1];
+
+	shm_begin();
+	if (last != cc) {
+		shm_cc[i] = last;
+		last->shmslot = i + 1;
+		shm_fill(last);
+	}
+	shm->nclients--;
+	shm_cc[shm->nclients] = NULL;
+	shm_end();
+	cc->shmslot = 0;
+}
+
+void
+shm_active(Window win)
+{
+	if (shm == NULL)
+		return;
+	shm_begin();
+	shm->active = win;
+	shm_end();
+}
+
+void
+shm_group(int num)
+{
+	if (shm == NULL)
+		return;
+	shm_begin();
+	shm->group = num;
+	shm_end();
+}
+
+void
+shm_groups(struct screen_ctx *sc)
+{
+	struct group_ctx	*gc;
+
+	if (shm == NULL)
+		return;
+	shm_begin();
+	TAILQ_FOREACH(gc, &sc->groupq, entry) {
+		if (gc->num >= 0 && gc->num < CWM_STATE_NGROUPS)
+			(void)strlcpy(shm->groupname[gc->num], gc->name,
+			    CWM_STATE_NAMELEN);
+	}
+	shm_end();
+}
@@ -0,0 +1,163 @@
+/*
+ * calmwm - the calm window manager
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * $OpenBSD$
+ */
+
+/*
+ * Deferred work.  Timers are owned by their callers and kept in a
+ * binary min-heap on their deadline; the main loop polls for at most
+ * timer_timeout() milliseconds and then runs whatever is due.
+ */
+
+#include <sys/types.h>
+#include "queue.h"
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calmwm.h"
+
+static struct timer	**heap;
+static int		  nheap, heapsz;
+
+static void	 timer_swap(int, int);
+static void	 timer_up(int);
+static void	 timer_down(int);
+static void	 timer_remove(int);
+
+static void
+timer_swap(int i, int j)
+{
+	struct timer	*t = heap[i];
+
+	heap[i] = heap[j];
+	heap[j] = t;
+	/* Stored one-based, so a zeroed timer is not armed. */
+	heap[i]->slot = i + 1;
+	heap[j]->slot = j + 1;
+}
+
+static void
+timer_up(int i)
+{
+	int	 p;
+
+	for (; i > 0; i = p) {
+		p = (i - 1) / 2;
+		if (heap[p]->due <= heap[i]->due)
+			break;
+		timer_swap(i, p);
+	}
+}
+
+static void
+timer_down(int i)
+{
+	int	 c;
+
+	for (; (c = 2 * i + 1) < nheap; i = c) {
+		if (c + 1 < nheap && heap[c + 1]->due < heap[c]->due)
+			c++;
+		if (heap[i]->due <= heap[c]->due)
+			break;
+		timer_swap(i, c);
+	}
+}
+
+static void
+timer_remove(int i)
+{
+	heap[i]->slot = 0;
+	if (--nheap == i)
+		return;
+	heap[i] = heap[nheap];
+	heap[i]->slot = i + 1;
+	timer_down(i);
+	timer_up(i);
+}
+
+/*
+ * Run cb(arg) in usec microseconds.  A timer that is already armed
+ * keeps the earlier of the two deadlines, so repeated requests for the
+ * same work coalesce into one run.
+ */
+void
+timer_add(struct timer *t, unsigned long long usec,
+    void (*cb)(void *), void *arg)
+{
+	unsigned long long	 due = u_time_usec() + usec;
+
+	t->cb = cb;
+	t->arg = arg;
+	if (t->slot != 0) {
+		if (due < t->due) {
+			t->due = due;
+			timer_up(t->slot - 1);
+		}
+		return;
+	}
+	if (nheap == heapsz) {
+		heapsz = heapsz ? heapsz * 2 : 16;
+		heap = xreallocarray(heap, heapsz, sizeof(*heap));
+	}
+	t->due = due;
+	t->slot = nheap + 1;
+	heap[nheap++] = t;
+	timer_up(nheap - 1);
+}
+
+void
+timer_del(struct timer *t)
+{
+	if (t->slot != 0)
+		timer_remove(t->slot - 1);
+}
+
+/* Milliseconds until the next timer is due, or -1 if none is armed. */
+int
+timer_timeout(void)
+{
+	unsigned long long	 now;
+
+	if (nheap == 0)
+		return -1;
+	now = u_time_usec();
+	if (heap[0]->due <= now)
+		return 0;
+	return (int)((heap[0]->due - now + 999) / 1000);
+}
+
+void
+timer_run(void)
+{
+	struct timer		*t;
+	unsigned long long	 now = u_time_usec();
+
+	/*
+	 * Only what was due before now: a callback re-arming its timer
+	 * waits for the next run instead of looping here.
+	 */
+	while (nheap > 0 && heap[0]->due < now) {
+		t = heap[0];
+		timer_remove(0);
+		(*t->cb)(t->arg);
+	}
+}
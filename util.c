@@ -20,46 +20,161 @@
 
 #include <sys/types.h>
 #include "queue.h"
+#include <sys/stat.h>
 
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <signal.h>
+#include <spawn.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "calmwm.h"
 
+/*
+ * Debug messages always go to a ring of the last LOG_RINGSZ entries,
+ * kept unformatted: the format, the function and the integer arguments.
+ * log_dump() writes the ring out for cwmtrace.pl; only messages at or
+ * below the -v level are also formatted to stderr.
+ */
+#define LOG_RINGSZ	4096	/* a power of two */
+#define LOG_NARGS	6
+#define LOG_MAGIC	"CWMRING"
+#define LOG_VERSION	1
+
+struct log_ent {
+	unsigned long long	 usec;
+	const char		*func;
+	const char		*fmt;
+	int			 level;
+	int			 nargs;
+	uint64_t		 arg[LOG_NARGS];
+};
+
+/* As written by log_dump(), followed by the function and format. */
+struct log_rec {
+	uint64_t		 usec;
+	uint32_t		 level;
+	uint32_t		 nargs;
+	uint64_t		 arg[LOG_NARGS];
+	uint16_t		 funclen;
+	uint16_t		 fmtlen;
+	uint32_t		 pad;
+};
+
+extern char		**environ;
+
+static struct log_ent	 log_ring[LOG_RINGSZ];
+static unsigned long	 log_next;
+static char		 log_path[PATH_MAX];
+
 static void	 log_msg(const char *, va_list);
+static int	 log_args(const char *, va_list, uint64_t *);
+static char	**u_argv_split(char *);
 
 void
 u_spawn(char *argstr)
 {
+#ifdef POSIX_SPAWN_SETSID
+	posix_spawnattr_t	 attr;
+	sigset_t		 sigdef, sigmask;
+	char			**args, *s;
+	pid_t			 pid;
+	int			 error;
+
+	/*
+	 * posix_spawn avoids copying our address space, which makes
+	 * bursts of launches cheap and keeps the event loop responsive.
+	 */
+	s = xstrdup(argstr);
+	args = u_argv_split(s);
+	if (args[0] != NULL) {
+		/* Children start without our ignored SIGPIPE or mask. */
+		sigemptyset(&sigdef);
+		sigaddset(&sigdef, SIGPIPE);
+		sigemptyset(&sigmask);
+		posix_spawnattr_init(&attr);
+		posix_spawnattr_setsigdefault(&attr, &sigdef);
+		posix_spawnattr_setsigmask(&attr, &sigmask);
+		posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID |
+		    POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+		error = posix_spawnp(&pid, args[0], NULL, &attr, args, environ);
+		if (error != 0) {
+			errno = error;
+			warn("%s", argstr);
+		} else
+			Stats.spawns++;
+		posix_spawnattr_destroy(&attr);
+	}
+	xfree(args);
+	xfree(s);
+#else
 	switch (fork()) {
 	case 0:
 		u_exec(argstr);
 		exit(1);
 	case -1:
 		warn("fork");
+		break;
 	default:
+		Stats.spawns++;
 		break;
 	}
+#endif
 }
 
 void
 u_exec(char *argstr)
 {
-#define MAXARGLEN 20
-	char	*args[MAXARGLEN], **ap = args;
-	char	**end = &args[MAXARGLEN - 2], *tmp;
-	char	*s = argstr;
+	sigset_t	 sigmask;
+	char		**args, *s;
+
+	s = xstrdup(argstr);
+	args = u_argv_split(s);
+	if (args[0] == NULL) {
+		xfree(args);
+		xfree(s);
+		return;
+	}
+
+	/* As for posix_spawn in u_spawn(). */
+	(void)signal(SIGPIPE, SIG_DFL);
+	sigemptyset(&sigmask);
+	(void)sigprocmask(SIG_SETMASK, &sigmask, NULL);
+	(void)setsid();
+	(void)execvp(args[0], args);
+	warn("%s", argstr);
+	xfree(args);
+	xfree(s);
+}
 
-	while (ap < end && (*ap = strsep(&argstr, " \t")) != NULL) {
-		if (**ap == '\0')
+/*
+ * Split argstr in place into a NULL-terminated argument vector,
+ * honouring single and double quotes.
+ */
+static char **
+u_argv_split(char *argstr)
+{
+	char	**args = NULL, *ap, *tmp;
+	size_t	 n = 0, nalloc = 0;
+
+	for (;;) {
+		if (n + 2 >= nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 16;
+			args = xreallocarray(args, nalloc, sizeof(*args));
+		}
+		if ((ap = strsep(&argstr, " \t")) == NULL)
+			break;
+		if (*ap == '\0')
 			continue;
-		ap++;
+		args[n++] = ap;
 		if (argstr != NULL) {
 			/* deal with quoted strings */
 			switch(argstr[0]) {
@@ -68,7 +183,7 @@ u_exec(char *argstr)
 				if ((tmp = strchr(argstr + 1, argstr[0]))
 				    != NULL) {
 					*(tmp++) = '\0';
-					*(ap++) = ++argstr;
+					args[n++] = ++argstr;
 					argstr = tmp;
 				}
 				break;
@@ -77,11 +192,9 @@ u_exec(char *argstr)
 			}
 		}
 	}
-	*ap = NULL;
+	args[n] = NULL;
 
-	(void)setsid();
-	(void)execvp(args[0], args);
-	warn("%s", s);
+	return args;
 }
 
 char *
@@ -108,6 +221,47 @@ u_argv(char * const *argv)
 	return p;
 }
 
+unsigned long long
+u_time_usec(void)
+{
+	struct timespec	 ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+		return 0;
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void
+u_stats_dump(void)
+{
+	int	 i;
+
+	fprintf(stderr, "group_switch: %lu\n", Stats.group_switch);
+	fprintf(stderr, "group_switch_usec: %llu\n", Stats.group_switch_usec);
+	fprintf(stderr, "group_switch_usec_max: %llu\n",
+	    Stats.group_switch_max);
+	fprintf(stderr, "border_requests: %lu\n", Stats.border_requests);
+	fprintf(stderr, "border_skipped: %lu\n", Stats.border_skipped);
+	fprintf(stderr, "enter_skipped: %lu\n", Stats.enter_skipped);
+	fprintf(stderr, "prop_coalesced: %lu\n", Stats.prop_coalesced);
+	fprintf(stderr, "configure_requests: %lu\n", Stats.configure_requests);
+	fprintf(stderr, "configure_merged: %lu\n", Stats.configure_merged);
+	fprintf(stderr, "configure_deferred: %lu\n", Stats.configure_deferred);
+	fprintf(stderr, "configure_applied: %lu\n", Stats.configure_applied);
+	fprintf(stderr, "ctl_commands: %lu\n", Stats.ctl_commands);
+	fprintf(stderr, "xsync: %lu\n", Stats.xsync);
+	fprintf(stderr, "menu_opens: %lu\n", Stats.menu_opens);
+	fprintf(stderr, "spawns: %lu\n", Stats.spawns);
+	fprintf(stderr, "allocs: %lu\n", Stats.allocs);
+	for (i = 0; i < XM_NTAGS; i++) {
+		fprintf(stderr, "mem_%s_live: %llu\n", xm_tag_name(i),
+		    Stats.mem[i].live);
+		fprintf(stderr, "mem_%s_peak: %llu\n", xm_tag_name(i),
+		    Stats.mem[i].peak);
+	}
+	fflush(stderr);
+}
+
 static void
 log_msg(const char *msg, va_list ap)
 {
@@ -118,7 +272,7 @@ log_msg(const char *msg, va_list ap)
 		fprintf(stderr, "\n");
 	} else {
 		vfprintf(stderr, fmt, ap);
-		free(fmt);
+		xfree(fmt);
 	}
 	fflush(stderr);
 }
@@ -126,8 +280,18 @@ log_msg(const char *msg, va_list ap)
 void
 log_debug(int level, const char *func, const char *msg, ...)
 {
-	char	*fmt;
-	va_list	 ap;
+	struct log_ent	*e;
+	char		*fmt;
+	va_list		 ap;
+
+	e = &log_ring[log_next++ & (LOG_RINGSZ - 1)];
+	e->usec = u_time_usec();
+	e->func = func;
+	e->fmt = msg;
+	e->level = level;
+	va_start(ap, msg);
+	e->nargs = log_args(msg, ap, e->arg);
+	va_end(ap);
 
 	if (Conf.debug < level)
 		return;
@@ -135,6 +299,118 @@ log_debug(int level, const char *func, const char *msg, ...)
 	va_start(ap, msg);
 	xasprintf(&fmt, "debug%d: %s: %s", level, func, msg);
 	log_msg(fmt, ap);
-	free(fmt);
+	xfree(fmt);
 	va_end(ap);
 }
+
+/* Take the arguments fmt refers to; strings only keep their address. */
+static int
+log_args(const char *fmt, va_list ap, uint64_t *arg)
+{
+	int	 n = 0, l;
+
+	for (; *fmt != '\0' && n < LOG_NARGS; fmt++) {
+		if (*fmt != '%')
+			continue;
+		fmt++;
+		fmt += strspn(fmt, "-+ #0123456789.");
+		for (l = 0; *fmt == 'l' || *fmt == 'h' || *fmt == 'z'; fmt++)
+			l += (*fmt == 'l') ? 1 : (*fmt == 'z') ? 2 : 0;
+		switch (*fmt) {
+		case 'd':
+		case 'i':
+		case 'c':
+			arg[n++] = (l >= 2) ? (uint64_t)va_arg(ap, long long) :
+			    (l == 1) ? (uint64_t)va_arg(ap, long) :
+			    (uint64_t)va_arg(ap, int);
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+			arg[n++] = (l >= 2) ?
+			    (uint64_t)va_arg(ap, unsigned long long) :
+			    (l == 1) ? (uint64_t)va_arg(ap, unsigned long) :
+			    (uint64_t)va_arg(ap, unsigned int);
+			break;
+		case 's':
+		case 'p':
+			arg[n++] = (uintptr_t)va_arg(ap, void *);
+			break;
+		case '\0':
+			return n;
+		default:
+			break;
+		}
+	}
+	return n;
+}
+
+void
+log_init(void)
+{
+	const char	*tmpdir;
+
+	if ((tmpdir = getenv("TMPDIR")) == NULL || *tmpdir == '\0')
+		tmpdir = "/tmp";
+	(void)snprintf(log_path, sizeof(log_path), "%s/cwm.%ld.trace",
+	    tmpdir, (long)getpid());
+}
+
+/*
+ * Write the ring to the trace file, oldest entry first.  Only uses
+ * async-signal-safe calls, so it can run from a crash handler.
+ */
+const char *
+log_dump(void)
+{
+	struct log_ent	*e;
+	struct log_rec	 rec;
+	char		 hdr[16];
+	struct stat	 sb;
+	uint32_t	 v;
+	unsigned long	 i, n;
+	int		 fd;
+
+	if (log_path[0] == '\0')
+		return NULL;
+	/*
+	 * The name is predictable and $TMPDIR may be shared: replace our
+	 * own earlier trace, but never follow or reuse what someone else
+	 * left there.
+	 */
+	(void)unlink(log_path);
+	if ((fd = open(log_path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW,
+	    S_IRUSR | S_IWUSR)) == -1)
+		return NULL;
+	if (fstat(fd, &sb) == -1 || !S_ISREG(sb.st_mode) ||
+	    sb.st_uid != geteuid()) {
+		close(fd);
+		return NULL;
+	}
+
+	n = (log_next < LOG_RINGSZ) ? log_next : LOG_RINGSZ;
+	memset(hdr, 0, sizeof(hdr));
+	memcpy(hdr, LOG_MAGIC, sizeof(LOG_MAGIC));
+	v = LOG_VERSION;
+	memcpy(hdr + 8, &v, sizeof(v));
+	v = n;
+	memcpy(hdr + 12, &v, sizeof(v));
+	(void)write(fd, hdr, sizeof(hdr));
+
+	for (i = log_next - n; i != log_next; i++) {
+		e = &log_ring[i & (LOG_RINGSZ - 1)];
+		memset(&rec, 0, sizeof(rec));
+		rec.usec = e->usec;
+		rec.level = e->level;
+		rec.nargs = e->nargs;
+		memcpy(rec.arg, e->arg, sizeof(rec.arg));
+		rec.funclen = strlen(e->func);
+		rec.fmtlen = strlen(e->fmt);
+		(void)write(fd, &rec, sizeof(rec));
+		(void)write(fd, e->func, rec.funclen);
+		(void)write(fd, e->fmt, rec.fmtlen);
+	}
+	close(fd);
+	return log_path;
+}
@@ -41,10 +41,22 @@ static void	 xev_handle_maprequest(XEvent *);
 static void	 xev_handle_unmapnotify(XEvent *);
 static void	 xev_handle_destroynotify(XEvent *);
 static void	 xev_handle_configurerequest(XEvent *);
+static Bool	 xev_configure_match(Display *, XEvent *, XPointer);
+static void	 xev_configure_merge(unsigned int *, XWindowChanges *,
+		     XConfigureRequestEvent *);
+static void	 xev_configure_fold(unsigned int *, XWindowChanges *,
+		     unsigned int, XWindowChanges *);
+static void	 xev_configure_apply(struct client_ctx *, unsigned int,
+		     XWindowChanges *, unsigned long long);
+static void	 xev_configure_flush(void *);
 static void	 xev_handle_propertynotify(XEvent *);
 static void	 xev_handle_enternotify(XEvent *);
+static int	 xev_enter_pending(void);
+static int	 xev_prop_key(Atom);
+static void	 xev_prop_coalesce(XPropertyEvent *);
 static void	 xev_handle_buttonpress(XEvent *);
 static void	 xev_handle_buttonrelease(XEvent *);
+static void	 xev_handle_motionnotify(XEvent *);
 static void	 xev_handle_keypress(XEvent *);
 static void	 xev_handle_keyrelease(XEvent *);
 static void	 xev_handle_clientmessage(XEvent *);
@@ -61,6 +73,7 @@ void		(*xev_handlers[LASTEvent])(XEvent *) = {
 			[EnterNotify] = xev_handle_enternotify,
 			[ButtonPress] = xev_handle_buttonpress,
 			[ButtonRelease] = xev_handle_buttonrelease,
+			[MotionNotify] = xev_handle_motionnotify,
 			[KeyPress] = xev_handle_keypress,
 			[KeyRelease] = xev_handle_keyrelease,
 			[ClientMessage] = xev_handle_clientmessage,
@@ -68,6 +81,8 @@ void		(*xev_handlers[LASTEvent])(XEvent *) = {
 			[Expose] = xev_handle_expose,
 };
 
+static struct timer	 xev_configure_timer;
+
 static KeySym modkeys[] = { XK_Control_L, XK_Control_R,
 			    XK_Alt_L, XK_Alt_R,
 			    XK_Meta_L, XK_Meta_R,
@@ -92,7 +107,8 @@ xev_handle_maprequest(XEvent *ee)
 	if ((cc = client_find(e->window)) == NULL)
 		cc = client_init(e->window, NULL);
 
-	if ((cc != NULL) && (!(cc->flags & CLIENT_IGNORE)))
+	/* Do not pull the pointer away from an open menu. */
+	if ((cc != NULL) && (!(cc->flags & CLIENT_IGNORE)) && !menu_active())
 		client_ptr_warp(cc);
 }
 
@@ -131,43 +147,46 @@ xev_handle_configurerequest(XEvent *ee)
 {
 	XConfigureRequestEvent	*e = &ee->xconfigurerequest;
 	struct client_ctx	*cc;
-	struct screen_ctx	*sc;
 	XWindowChanges		 wc;
+	XEvent			 next;
+	unsigned int		 mask;
+	unsigned long long	 now, ival;
 
 	LOG_DEBUG3("window: 0x%lx", e->window);
 
 	if ((cc = client_find(e->window)) != NULL) {
-		sc = cc->sc;
-
-		if (e->value_mask & CWWidth)
-			cc->geom.w = e->width;
-		if (e->value_mask & CWHeight)
-			cc->geom.h = e->height;
-		if (e->value_mask & CWX)
-			cc->geom.x = e->x;
-		if (e->value_mask & CWY)
-			cc->geom.y = e->y;
-		if (e->value_mask & CWBorderWidth)
-			cc->bwidth = e->border_width;
-		if (e->value_mask & CWSibling)
-			wc.sibling = e->above;
-		if (e->value_mask & CWStackMode)
-			wc.stack_mode = e->detail;
-
-		if (cc->geom.x == 0 && cc->geom.w >= sc->view.w)
-			cc->geom.x -= cc->bwidth;
-
-		if (cc->geom.y == 0 && cc->geom.h >= sc->view.h)
-			cc->geom.y -= cc->bwidth;
-
-		wc.x = cc->geom.x;
-		wc.y = cc->geom.y;
-		wc.width = cc->geom.w;
-		wc.height = cc->geom.h;
-		wc.border_width = cc->bwidth;
-
-		XConfigureWindow(X_Dpy, cc->win, e->value_mask, &wc);
-		client_config(cc);
+		Stats.configure_requests++;
+		mask = 0;
+		xev_configure_merge(&mask, &wc, e);
+
+		/* Fold in requests for this window that are already queued. */
+		while (XCheckIfEvent(X_Dpy, &next, xev_configure_match,
+		    (XPointer)&e->window)) {
+			xev_record_fold(&next);
+			Stats.configure_requests++;
+			Stats.configure_merged++;
+			xev_configure_merge(&mask, &wc, &next.xconfigurerequest);
+		}
+
+		if (cc->cfg.mask != 0) {
+			xev_configure_fold(&cc->cfg.mask, &cc->cfg.wc, mask, &wc);
+			mask = cc->cfg.mask;
+			wc = cc->cfg.wc;
+		}
+		now = u_time_usec();
+		ival = (Conf.configurerate > 0) ?
+		    1000000ULL / Conf.configurerate : 0;
+		if (now - cc->cfg.last < ival) {
+			/* Over the rate; keep it for xev_configure_flush(). */
+			cc->cfg.mask = mask;
+			cc->cfg.wc = wc;
+			timer_add(&xev_configure_timer, cc->cfg.last + ival - now,
+			    xev_configure_flush, NULL);
+			Stats.configure_deferred++;
+			return;
+		}
+		cc->cfg.mask = 0;
+		xev_configure_apply(cc, mask, &wc, now);
 	} else {
 		/* let it do what it wants, it'll be ours when we map it. */
 		wc.x = e->x;
@@ -182,6 +201,126 @@ xev_handle_configurerequest(XEvent *ee)
 	}
 }
 
+static Bool
+xev_configure_match(Display *dpy, XEvent *e, XPointer arg)
+{
+	return (e->type == ConfigureRequest &&
+	    e->xconfigurerequest.window == *(Window *)arg);
+}
+
+/* Merge a request into mask and wc; the later value wins per field. */
+static void
+xev_configure_merge(unsigned int *mask, XWindowChanges *wc,
+    XConfigureRequestEvent *e)
+{
+	XWindowChanges	 req;
+
+	req.x = e->x;
+	req.y = e->y;
+	req.width = e->width;
+	req.height = e->height;
+	req.border_width = e->border_width;
+	req.sibling = e->above;
+	req.stack_mode = e->detail;
+	xev_configure_fold(mask, wc, e->value_mask, &req);
+}
+
+static void
+xev_configure_fold(unsigned int *mask, XWindowChanges *wc,
+    unsigned int rmask, XWindowChanges *req)
+{
+	if (rmask & CWX)
+		wc->x = req->x;
+	if (rmask & CWY)
+		wc->y = req->y;
+	if (rmask & CWWidth)
+		wc->width = req->width;
+	if (rmask & CWHeight)
+		wc->height = req->height;
+	if (rmask & CWBorderWidth)
+		wc->border_width = req->border_width;
+	if (rmask & CWStackMode) {
+		wc->stack_mode = req->stack_mode;
+		/* A sibling only applies to the stack mode it came with. */
+		*mask &= ~CWSibling;
+		if (rmask & CWSibling)
+			wc->sibling = req->sibling;
+	}
+	*mask |= rmask;
+}
+
+static void
+xev_configure_apply(struct client_ctx *cc, unsigned int mask,
+    XWindowChanges *req, unsigned long long now)
+{
+	struct screen_ctx	*sc = cc->sc;
+	XWindowChanges		 wc;
+
+	if (mask & CWWidth)
+		cc->geom.w = req->width;
+	if (mask & CWHeight)
+		cc->geom.h = req->height;
+	if (mask & CWX)
+		cc->geom.x = req->x;
+	if (mask & CWY)
+		cc->geom.y = req->y;
+	if (mask & CWBorderWidth)
+		cc->bwidth = req->border_width;
+	if (mask & CWSibling)
+		wc.sibling = req->sibling;
+	if (mask & CWStackMode)
+		wc.stack_mode = req->stack_mode;
+
+	if (cc->geom.x == 0 && cc->geom.w >= sc->view.w)
+		cc->geom.x -= cc->bwidth;
+
+	if (cc->geom.y == 0 && cc->geom.h >= sc->view.h)
+		cc->geom.y -= cc->bwidth;
+
+	wc.x = cc->geom.x;
+	wc.y = cc->geom.y;
+	wc.width = cc->geom.w;
+	wc.height = cc->geom.h;
+	wc.border_width = cc->bwidth;
+
+	XConfigureWindow(X_Dpy, cc->win, mask, &wc);
+	if (mask & CWBorderWidth)
+		cc->abwidth = cc->bwidth;
+	client_config(cc);
+	cc->cfg.last = now;
+	Stats.configure_applied++;
+}
+
+/* Apply deferred requests that are due and wait for the rest. */
+static void
+xev_configure_flush(void *arg)
+{
+	struct screen_ctx	*sc;
+	struct client_ctx	*cc;
+	unsigned long long	 now, ival, due, next = ULLONG_MAX;
+
+	now = u_time_usec();
+	ival = (Conf.configurerate > 0) ? 1000000ULL / Conf.configurerate : 0;
+	TAILQ_FOREACH(sc, &Screenq, entry) {
+		TAILQ_FOREACH(cc, &sc->clientq, entry) {
+			if (cc->cfg.mask == 0)
+				continue;
+			due = cc->cfg.last + ival;
+			if (due > now) {
+				if (due < next)
+					next = due;
+				continue;
+			}
+			xev_configure_apply(cc, cc->cfg.mask, &cc->cfg.wc, now);
+			cc->cfg.mask = 0;
+		}
+	}
+	/* Clients that went away are simply not found again. */
+	if (next != ULLONG_MAX)
+		timer_add(&xev_configure_timer, next - now,
+		    xev_configure_flush, NULL);
+}
+
 static void
 xev_handle_propertynotify(XEvent *ee)
 {
@@ -192,12 +331,15 @@ xev_handle_propertynotify(XEvent *ee)
 	LOG_DEBUG3("window: 0x%lx", e->window);
 
 	if ((cc = client_find(e->window)) != NULL) {
+		xev_prop_coalesce(e);
 		switch (e->atom) {
 		case XA_WM_NORMAL_HINTS:
 			client_get_sizehints(cc);
 			break;
 		case XA_WM_NAME:
 			client_set_name(cc);
+			/* Only for managed clients; a new one is "map"ped. */
+			ctl_event("title 0x%lx %s", cc->win, cc->name);
 			break;
 		case XA_WM_HINTS:
 			client_wm_hints(cc);
@@ -210,8 +352,17 @@ xev_handle_propertynotify(XEvent *ee)
 				group_movetogroup(cc, cc->gc->num);
 			break;
 		default:
-			if (e->atom == ewmh[_NET_WM_NAME])
+			if (e->atom == ewmh[_NET_WM_NAME]) {
 				client_set_name(cc);
+				ctl_event("title 0x%lx %s", cc->win,
+				    cc->name);
+			} else if (e->atom == ewmh[_NET_WM_STATE]) {
+				/* Skip the echo of our own writes. */
+				if (cc->fstate_pending > 0)
+					cc->fstate_pending--;
+				else
+					xu_ewmh_update_net_wm_state(cc);
+			}
 			break;
 		}
 	} else {
@@ -222,6 +373,47 @@ xev_handle_propertynotify(XEvent *ee)
 	}
 }
 
+/*
+ * Property values are re-read when handled, so later notifications for
+ * the same window and property that are already queued carry nothing
+ * new; drop them.  Both name atoms are read by client_set_name().
+ * _NET_WM_STATE is left alone, as each event there is counted.
+ */
+static int
+xev_prop_key(Atom atom)
+{
+	if (atom == XA_WM_NAME || atom == ewmh[_NET_WM_NAME])
+		return 1;
+	if (atom == XA_WM_NORMAL_HINTS)
+		return 2;
+	if (atom == XA_WM_HINTS)
+		return 3;
+	return 0;
+}
+
+static Bool
+xev_prop_match(Display *dpy, XEvent *e, XPointer arg)
+{
+	XPropertyEvent	*pe = (XPropertyEvent *)arg;
+
+	return (e->type == PropertyNotify &&
+	    e->xproperty.window == pe->window &&
+	    xev_prop_key(e->xproperty.atom) == xev_prop_key(pe->atom));
+}
+
+static void
+xev_prop_coalesce(XPropertyEvent *e)
+{
+	XEvent	 dup;
+
+	if (xev_prop_key(e->atom) == 0)
+		return;
+	while (XCheckIfEvent(X_Dpy, &dup, xev_prop_match, (XPointer)e)) {
+		xev_record_fold(&dup);
+		Stats.prop_coalesced++;
+	}
+}
+
 static void
 xev_handle_enternotify(XEvent *ee)
 {
@@ -232,8 +424,62 @@ xev_handle_enternotify(XEvent *ee)
 
 	Last_Event_Time = e->time;
 
-	if ((cc = client_find(e->window)) != NULL)
-		client_set_active(cc);
+	if ((cc = client_find(e->window)) == NULL)
+		return;
+
+	/*
+	 * If the pointer has already moved on to another client, the
+	 * focus change would be undone right away; leave it to the last
+	 * enter in the queue.
+	 */
+	if (xev_enter_pending()) {
+		Stats.enter_skipped++;
+		return;
+	}
+	client_set_active(cc);
+}
+
+struct enter_scan {
+	int		 done;
+	int		 found;
+};
+
+static Bool
+xev_enter_scan(Display *dpy, XEvent *e, XPointer arg)
+{
+	struct enter_scan	*es = (struct enter_scan *)arg;
+
+	if (es->done)
+		return False;
+	switch (e->type) {
+	case EnterNotify:
+		if (client_find(e->xcrossing.window) != NULL)
+			es->found = 1;
+		break;
+	/* Events that act on, or change, the current client. */
+	case KeyPress:
+	case KeyRelease:
+	case ButtonPress:
+	case ButtonRelease:
+	case MapRequest:
+	case UnmapNotify:
+	case DestroyNotify:
+	case ClientMessage:
+		es->done = 1;
+		break;
+	}
+	/* Only look; leave every event in the queue. */
+	return False;
+}
+
+static int
+xev_enter_pending(void)
+{
+	struct enter_scan	 es = { 0, 0 };
+	XEvent			 e;
+
+	(void)XCheckIfEvent(X_Dpy, &e, xev_enter_scan, (XPointer)&es);
+	return es.found;
 }
 
 static void
@@ -247,6 +493,9 @@ xev_handle_buttonpress(XEvent *ee)
 	LOG_DEBUG3("root: 0x%lx window: 0x%lx subwindow: 0x%lx",
 	    e->root, e->window, e->subwindow);
 
+	if (kbfunc_drag_event(ee))
+		return;
+
 	if ((sc = screen_find(e->root)) == NULL)
 		return;
 
@@ -284,6 +533,9 @@ xev_handle_buttonrelease(XEvent *ee)
 	LOG_DEBUG3("root: 0x%lx window: 0x%lx subwindow: 0x%lx",
 	    e->root, e->window, e->subwindow);
 
+	if (kbfunc_drag_event(ee))
+		return;
+
 	if ((cc = client_find(e->window)) != NULL) {
 		if (cc->flags & (CLIENT_ACTIVE | CLIENT_HIGHLIGHT)) {
 			cc->flags &= ~CLIENT_HIGHLIGHT;
@@ -292,6 +544,12 @@ xev_handle_buttonrelease(XEvent *ee)
 	}
 }
 
+static void
+xev_handle_motionnotify(XEvent *ee)
+{
+	kbfunc_drag_event(ee);
+}
+
 static void
 xev_handle_keypress(XEvent *ee)
 {
@@ -328,6 +586,8 @@ xev_handle_keypress(XEvent *ee)
 	if (kb == NULL)
 		return;
 	kb->cargs->xev = CWM_XEV_KEY;
+	kb->cargs->keycode = e->keycode;
+	kb->cargs->state = e->state;
 	switch (kb->context) {
 	case CWM_CONTEXT_CC:
 		if (((cc = client_find(e->subwindow)) == NULL) &&
@@ -446,8 +706,7 @@ xev_handle_randr(XEvent *ee)
 		return;
 
 	XRRUpdateConfiguration(ee);
-	screen_update_geometry(sc);
-	screen_assert_clients_within(sc);
+	screen_randr_defer(sc);
 }
 
 /*
@@ -488,9 +747,31 @@ xev_process(void)
 
 	while (XPending(X_Dpy)) {
 		XNextEvent(X_Dpy, &e);
-		if ((e.type - Conf.xrandr_event_base) == RRScreenChangeNotify)
-			xev_handle_randr(&e);
-		else if ((e.type < LASTEvent) && (xev_handlers[e.type] != NULL))
-			(*xev_handlers[e.type])(&e);
+		xev_record(&e);
+		xev_handle(&e);
 	}
+	xev_flush();
+}
+
+/* End of a batch of events: apply the work deferred until now. */
+void
+xev_flush(void)
+{
+	xev_record(NULL);
+	layout_flush();
+}
+
+void
+xev_handle(XEvent *e)
+{
+	unsigned long long	 start = u_time_usec();
+
+	if ((e->type - Conf.xrandr_event_base) == RRScreenChangeNotify)
+		xev_handle_randr(e);
+	else if (menu_event(e))
+		;	/* taken by an open menu */
+	else if ((e->type < LASTEvent) && (xev_handlers[e->type] != NULL))
+		(*xev_handlers[e->type])(e);
+
+	metrics_handler(e->type, u_time_usec() - start);
 }
@@ -33,8 +33,171 @@
 
 #include "calmwm.h"
 
+/*
+ * Allocation accounting, switched on with cwm -a.  Live blocks are kept
+ * in an open addressing table keyed on their address, so that xfree()
+ * knows the size and tag of what it frees; pointers that were never
+ * recorded, such as those allocated before accounting started or by
+ * other libraries, are passed through untouched.
+ */
+struct xm_ent {
+	void		*p;
+	size_t		 size;
+	int		 tag;
+};
+
+static const struct {
+	const char	*file;
+	int		 tag;
+} xm_files[] = {
+	{ "client.c",	XM_CLIENT },
+	{ "menu.c",	XM_MENU },
+	{ "search.c",	XM_SEARCH },
+	{ "conf.c",	XM_CONF },
+	{ "parse.y",	XM_CONF },
+	{ "parse.c",	XM_CONF },
+	{ "xutil.c",	XM_EWMH },
+};
+
+static const char *xm_names[XM_NTAGS] = {
+	[XM_OTHER] = "other",
+	[XM_CLIENT] = "client",
+	[XM_MENU] = "menu",
+	[XM_SEARCH] = "search",
+	[XM_CONF] = "conf",
+	[XM_EWMH] = "ewmh",
+};
+
+static int		 xm_on;
+static struct xm_ent	*xm_tab;
+static size_t		 xm_tabsz, xm_count;
+
+static int		 xm_tag(const char *);
+static size_t		 xm_slot(void *);
+static void		 xm_grow(void);
+static void		 xm_record(const char *, void *, size_t);
+static void		 xm_forget(void *);
+
+void
+xm_account(void)
+{
+	xm_on = 1;
+}
+
+const char *
+xm_tag_name(int tag)
+{
+	return xm_names[tag];
+}
+
+static int
+xm_tag(const char *file)
+{
+	static const char	*last;
+	static int		 lasttag;
+	const char		*base;
+	size_t			 i;
+
+	/* __FILE__ is the same literal for all calls from a file. */
+	if (file == last)
+		return lasttag;
+	if ((base = strrchr(file, '/')) != NULL)
+		base++;
+	else
+		base = file;
+	last = file;
+	lasttag = XM_OTHER;
+	for (i = 0; i < nitems(xm_files); i++) {
+		if (strcmp(base, xm_files[i].file) == 0) {
+			lasttag = xm_files[i].tag;
+			break;
+		}
+	}
+	return lasttag;
+}
+
+static size_t
+xm_slot(void *p)
+{
+	return (((uintptr_t)p >> 4) * 0x9e3779b9UL) & (xm_tabsz - 1);
+}
+
+static void
+xm_grow(void)
+{
+	struct xm_ent	*old = xm_tab;
+	size_t		 oldsz = xm_tabsz, i, j;
+
+	xm_tabsz = oldsz ? oldsz * 2 : 1024;
+	if ((xm_tab = calloc(xm_tabsz, sizeof(*xm_tab))) == NULL)
+		err(1, "calloc");
+	for (i = 0; i < oldsz; i++) {
+		if (old[i].p == NULL)
+			continue;
+		for (j = xm_slot(old[i].p); xm_tab[j].p != NULL;
+		    j = (j + 1) & (xm_tabsz - 1))
+			;
+		xm_tab[j] = old[i];
+	}
+	free(old);
+}
+
+static void
+xm_record(const char *file, void *p, size_t size)
+{
+	size_t	 i;
+	int	 tag;
+
+	Stats.allocs++;
+	if (!xm_on)
+		return;
+	if (2 * (xm_count + 1) > xm_tabsz)
+		xm_grow();
+	for (i = xm_slot(p); xm_tab[i].p != NULL; i = (i + 1) & (xm_tabsz - 1))
+		;
+	tag = xm_tag(file);
+	xm_tab[i].p = p;
+	xm_tab[i].size = size;
+	xm_tab[i].tag = tag;
+	xm_count++;
+
+	Stats.mem[tag].live += size;
+	if (Stats.mem[tag].live > Stats.mem[tag].peak)
+		Stats.mem[tag].peak = Stats.mem[tag].live;
+}
+
+static void
+xm_forget(void *p)
+{
+	size_t	 i, j, k;
+
+	if (xm_count == 0 || p == NULL)
+		return;
+	for (i = xm_slot(p); xm_tab[i].p != p; i = (i + 1) & (xm_tabsz - 1))
+		if (xm_tab[i].p == NULL)
+			return;
+	Stats.mem[xm_tab[i].tag].live -= xm_tab[i].size;
+	xm_count--;
+
+	/* Move up entries of the run that would no longer be found. */
+	for (j = i;;) {
+		xm_tab[i].p = NULL;
+		for (;;) {
+			j = (j + 1) & (xm_tabsz - 1);
+			if (xm_tab[j].p == NULL)
+				return;
+			k = xm_slot(xm_tab[j].p);
+			if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+				continue;
+			break;
+		}
+		xm_tab[i] = xm_tab[j];
+		i = j;
+	}
+}
+
 void *
-xmalloc(size_t siz)
+xm_malloc(const char *file, size_t siz)
 {
 	void	*p;
 
@@ -42,12 +205,13 @@ xmalloc(size_t siz)
 		errx(1, "xmalloc: zero size");
 	if ((p = malloc(siz)) == NULL)
 		err(1, "malloc");
+	xm_record(file, p, siz);
 
 	return p;
 }
 
 void *
-xcalloc(size_t no, size_t siz)
+xm_calloc(const char *file, size_t no, size_t siz)
 {
 	void	*p;
 
@@ -57,54 +221,67 @@ xcalloc(size_t no, size_t siz)
 		errx(1, "xcalloc: no * siz > SIZE_MAX");
 	if ((p = calloc(no, siz)) == NULL)
 		err(1, "calloc");
+	xm_record(file, p, no * siz);
 
 	return p;
 }
 
 void *
-xreallocarray(void *ptr, size_t nmemb, size_t size)
+xm_reallocarray(const char *file, void *ptr, size_t nmemb, size_t size)
 {
 	void	*p;
 
+	/* Failure is fatal, so ptr can be forgotten up front. */
+	xm_forget(ptr);
 	p = reallocarray(ptr, nmemb, size);
 	if (p == NULL)
 		errx(1, "xreallocarray: out of memory (new_size %zu bytes)",
 		    nmemb * size);
+	xm_record(file, p, nmemb * size);
 	return p;
 }
 
 char *
-xstrdup(const char *str)
+xm_strdup(const char *file, const char *str)
 {
 	char	*p;
 
 	if ((p = strdup(str)) == NULL)
 		err(1, "strdup");
+	xm_record(file, p, strlen(p) + 1);
 
 	return p;
 }
 
 int
-xasprintf(char **ret, const char *fmt, ...)
+xm_asprintf(const char *file, char **ret, const char *fmt, ...)
 {
 	va_list	 ap;
 	int	 i;
 
 	va_start(ap, fmt);
-	i = xvasprintf(ret, fmt, ap);
+	i = xm_vasprintf(file, ret, fmt, ap);
 	va_end(ap);
 
 	return i;
 }
 
 int
-xvasprintf(char **ret, const char *fmt, va_list ap)
+xm_vasprintf(const char *file, char **ret, const char *fmt, va_list ap)
 {
 	int	 i;
 
 	i = vasprintf(ret, fmt, ap);
 	if (i == -1)
 		err(1, "vasprintf");
+	xm_record(file, *ret, i + 1);
 
 	return i;
 }
+
+void
+xfree(void *p)
+{
+	xm_forget(p);
+	free(p);
+}
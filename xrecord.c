@@ -0,0 +1,452 @@
+/*
+ * calmwm - the calm window manager
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * $OpenBSD$
+ */
+
+/*
+ * Event recording and replay.
+ *
+ * A trace starts with a header (magic and version), followed by one
+ * record per event: a 64-bit timestamp in microseconds since the start
+ * of recording, a 16-bit event type, a 16-bit payload length and the
+ * payload, which is only as large as the structure for that type.
+ * RandR events are stored relative to the extension's event base.
+ * A record of type TRACE_FLUSH marks the end of one batch of events,
+ * so that a replay flushes deferred work at the same points.  Events a
+ * handler took off the queue to fold into the one it handles carry
+ * TRACE_FOLD and follow the record of that event.
+ *
+ * The header keeps the recording server's default root.  On replay,
+ * windows the trace shows being created or mapped get a stand-in on
+ * the replay server, and window ids are translated to those.
+ */
+
+#include <sys/types.h>
+#include "queue.h"
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calmwm.h"
+
+#define TRACE_MAGIC	"CWMTRACE"
+#define TRACE_VERSION	2
+#define TRACE_FLUSH	0
+#define TRACE_FOLD	0x4000
+#define TRACE_RANDR	0x8000
+#define TRACE_NFOLD	64
+/* Marks events put back for a replayed handler to fold. */
+#define TRACE_SERIAL	(~0UL)
+
+struct trace_hdr {
+	char		 magic[8];
+	uint32_t	 version;
+	uint32_t	 root;	/* version 2 */
+};
+
+struct trace_rec {
+	uint64_t	 usec;
+	uint16_t	 type;
+	uint16_t	 len;
+};
+
+static const size_t evsize[LASTEvent] = {
+	[KeyPress] = sizeof(XKeyEvent),
+	[KeyRelease] = sizeof(XKeyEvent),
+	[ButtonPress] = sizeof(XButtonEvent),
+	[ButtonRelease] = sizeof(XButtonEvent),
+	[MotionNotify] = sizeof(XMotionEvent),
+	[EnterNotify] = sizeof(XCrossingEvent),
+	[LeaveNotify] = sizeof(XCrossingEvent),
+	[FocusIn] = sizeof(XFocusChangeEvent),
+	[FocusOut] = sizeof(XFocusChangeEvent),
+	[Expose] = sizeof(XExposeEvent),
+	[CreateNotify] = sizeof(XCreateWindowEvent),
+	[DestroyNotify] = sizeof(XDestroyWindowEvent),
+	[UnmapNotify] = sizeof(XUnmapEvent),
+	[MapNotify] = sizeof(XMapEvent),
+	[MapRequest] = sizeof(XMapRequestEvent),
+	[ReparentNotify] = sizeof(XReparentEvent),
+	[ConfigureNotify] = sizeof(XConfigureEvent),
+	[ConfigureRequest] = sizeof(XConfigureRequestEvent),
+	[PropertyNotify] = sizeof(XPropertyEvent),
+	[ClientMessage] = sizeof(XClientMessageEvent),
+	[MappingNotify] = sizeof(XMappingEvent),
+};
+
+struct replay_map {
+	Window		 from;
+	Window		 to;
+	int		 standin;
+#define STANDIN_NONE	0
+#define STANDIN_LIVE	1
+#define STANDIN_GONE	2
+};
+
+static FILE			*recfp;
+static unsigned long long	 recstart;
+static struct replay_map	*rmap;
+static size_t			 rmapsz, rmapn;
+
+static void	 xev_record_write(XEvent *, int);
+static struct replay_map *replay_lookup(Window);
+static void	 replay_add(Window, Window, int);
+static Window	 replay_id(Window);
+static void	 replay_standin(Window, int, int, int, int);
+static void	 replay_translate(XEvent *);
+static int	 replay_read(FILE *, struct trace_rec *, XEvent *,
+		     const char *);
+static Bool	 replay_leftover(Display *, XEvent *, XPointer);
+
+void
+xev_record_open(const char *path)
+{
+	struct trace_hdr	 hdr;
+
+	if ((recfp = fopen(path, "w")) == NULL)
+		err(1, "%s", path);
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = TRACE_VERSION;
+	hdr.root = DefaultRootWindow(X_Dpy);
+	if (fwrite(&hdr, sizeof(hdr), 1, recfp) != 1)
+		err(1, "%s", path);
+	recstart = u_time_usec();
+}
+
+static void
+xev_record_write(XEvent *e, int flags)
+{
+	struct trace_rec	 rec;
+	size_t			 len;
+
+	if (recfp == NULL)
+		return;
+
+	rec.usec = u_time_usec() - recstart;
+	if (e == NULL) {
+		rec.type = TRACE_FLUSH;
+		len = 0;
+	} else if ((e->type - Conf.xrandr_event_base) ==
+	    RRScreenChangeNotify) {
+		rec.type = TRACE_RANDR | RRScreenChangeNotify;
+		len = sizeof(XRRScreenChangeNotifyEvent);
+	} else {
+		rec.type = e->type;
+		len = (e->type < LASTEvent && evsize[e->type] != 0) ?
+		    evsize[e->type] : sizeof(XEvent);
+	}
+	rec.type |= flags;
+	rec.len = len;
+	if (fwrite(&rec, sizeof(rec), 1, recfp) != 1 ||
+	    (len > 0 && fwrite(e, len, 1, recfp) != 1)) {
+		warn("event trace");
+		fclose(recfp);
+		recfp = NULL;
+		return;
+	}
+	/* Keep the trace useful up to a crash. */
+	if (e == NULL)
+		fflush(recfp);
+}
+
+void
+xev_record(XEvent *e)
+{
+	xev_record_write(e, 0);
+}
+
+/* Record an event taken off the queue to be folded into another. */
+void
+xev_record_fold(XEvent *e)
+{
+	xev_record_write(e, TRACE_FOLD);
+}
+
+void
+xev_record_close(void)
+{
+	if (recfp != NULL)
+		fclose(recfp);
+	recfp = NULL;
+}
+
+static struct replay_map *
+replay_lookup(Window w)
+{
+	size_t	 i;
+
+	if (rmapn == 0 || w == None)
+		return NULL;
+	for (i = (w * 0x9e3779b9UL) & (rmapsz - 1); rmap[i].from != None;
+	    i = (i + 1) & (rmapsz - 1))
+		if (rmap[i].from == w)
+			return &rmap[i];
+	return NULL;
+}
+
+static void
+replay_add(Window from, Window to, int standin)
+{
+	struct replay_map	*old = rmap;
+	size_t			 oldsz = rmapsz, i;
+
+	if (2 * (rmapn + 1) > rmapsz) {
+		rmapsz = rmapsz ? rmapsz * 2 : 256;
+		rmap = xcalloc(rmapsz, sizeof(*rmap));
+		rmapn = 0;
+		for (i = 0; i < oldsz; i++)
+			if (old[i].from != None)
+				replay_add(old[i].from, old[i].to,
+				    old[i].standin);
+		xfree(old);
+	}
+	for (i = (from * 0x9e3779b9UL) & (rmapsz - 1); rmap[i].from != None;
+	    i = (i + 1) & (rmapsz - 1))
+		;
+	rmap[i].from = from;
+	rmap[i].to = to;
+	rmap[i].standin = standin;
+	rmapn++;
+}
+
+static Window
+replay_id(Window w)
+{
+	struct replay_map	*m;
+
+	return ((m = replay_lookup(w)) != NULL) ? m->to : w;
+}
+
+/* A window of the recording server, created here in its place. */
+static void
+replay_standin(Window w, int x, int y, int width, int height)
+{
+	struct replay_map	*m;
+	Window			 win;
+
+	if (w == None)
+		return;
+	/* Ids are reused once the recorded window is destroyed. */
+	if ((m = replay_lookup(w)) != NULL && m->standin != STANDIN_GONE)
+		return;
+	win = XCreateSimpleWindow(X_Dpy, DefaultRootWindow(X_Dpy), x, y,
+	    MAX(width, 1), MAX(height, 1), 0, 0, 0);
+	if (m != NULL) {
+		m->to = win;
+		m->standin = STANDIN_LIVE;
+	} else
+		replay_add(w, win, STANDIN_LIVE);
+}
+
+static void
+replay_translate(XEvent *e)
+{
+	struct replay_map	*m;
+
+	if ((e->type - Conf.xrandr_event_base) == RRScreenChangeNotify) {
+		XRRScreenChangeNotifyEvent *re =
+		    (XRRScreenChangeNotifyEvent *)e;
+
+		re->window = replay_id(re->window);
+		re->root = replay_id(re->root);
+		return;
+	}
+
+	switch (e->type) {
+	case KeyPress:
+	case KeyRelease:
+		e->xkey.window = replay_id(e->xkey.window);
+		e->xkey.root = replay_id(e->xkey.root);
+		e->xkey.subwindow = replay_id(e->xkey.subwindow);
+		break;
+	case ButtonPress:
+	case ButtonRelease:
+		e->xbutton.window = replay_id(e->xbutton.window);
+		e->xbutton.root = replay_id(e->xbutton.root);
+		e->xbutton.subwindow = replay_id(e->xbutton.subwindow);
+		break;
+	case MotionNotify:
+		e->xmotion.window = replay_id(e->xmotion.window);
+		e->xmotion.root = replay_id(e->xmotion.root);
+		e->xmotion.subwindow = replay_id(e->xmotion.subwindow);
+		break;
+	case EnterNotify:
+	case LeaveNotify:
+		e->xcrossing.window = replay_id(e->xcrossing.window);
+		e->xcrossing.root = replay_id(e->xcrossing.root);
+		e->xcrossing.subwindow = replay_id(e->xcrossing.subwindow);
+		break;
+	case CreateNotify:
+		replay_standin(e->xcreatewindow.window, e->xcreatewindow.x,
+		    e->xcreatewindow.y, e->xcreatewindow.width,
+		    e->xcreatewindow.height);
+		e->xcreatewindow.parent = replay_id(e->xcreatewindow.parent);
+		e->xcreatewindow.window = replay_id(e->xcreatewindow.window);
+		break;
+	case DestroyNotify:
+		e->xdestroywindow.event = replay_id(e->xdestroywindow.event);
+		e->xdestroywindow.window = replay_id(e->xdestroywindow.window);
+		break;
+	case UnmapNotify:
+		e->xunmap.event = replay_id(e->xunmap.event);
+		e->xunmap.window = replay_id(e->xunmap.window);
+		break;
+	case MapNotify:
+		e->xmap.event = replay_id(e->xmap.event);
+		e->xmap.window = replay_id(e->xmap.window);
+		break;
+	case MapRequest:
+		/* Created before the recording started. */
+		replay_standin(e->xmaprequest.window, 0, 0, 200, 150);
+		e->xmaprequest.parent = replay_id(e->xmaprequest.parent);
+		e->xmaprequest.window = replay_id(e->xmaprequest.window);
+		break;
+	case ReparentNotify:
+		e->xreparent.event = replay_id(e->xreparent.event);
+		e->xreparent.window = replay_id(e->xreparent.window);
+		e->xreparent.parent = replay_id(e->xreparent.parent);
+		break;
+	case ConfigureNotify:
+		e->xconfigure.event = replay_id(e->xconfigure.event);
+		e->xconfigure.window = replay_id(e->xconfigure.window);
+		e->xconfigure.above = replay_id(e->xconfigure.above);
+		break;
+	case ConfigureRequest:
+		e->xconfigurerequest.parent =
+		    replay_id(e->xconfigurerequest.parent);
+		e->xconfigurerequest.window =
+		    replay_id(e->xconfigurerequest.window);
+		e->xconfigurerequest.above =
+		    replay_id(e->xconfigurerequest.above);
+		break;
+	default:
+		/* The rest only name the window they are reported on. */
+		if ((m = replay_lookup(e->xany.window)) != NULL)
+			e->xany.window = m->to;
+		break;
+	}
+}
+
+/* Read one record; 0 at the end of the trace. */
+static int
+replay_read(FILE *fp, struct trace_rec *rec, XEvent *e, const char *path)
+{
+	if (fread(rec, sizeof(*rec), 1, fp) != 1)
+		return 0;
+	if (rec->len > sizeof(*e))
+		errx(1, "%s: corrupt record", path);
+	memset(e, 0, sizeof(*e));
+	if (rec->len > 0 && fread(e, rec->len, 1, fp) != 1)
+		return 0;
+	if (rec->type == TRACE_FLUSH)
+		return 1;
+	if (rec->type & TRACE_RANDR)
+		e->type = Conf.xrandr_event_base +
+		    (rec->type & ~(TRACE_RANDR | TRACE_FOLD));
+	else
+		e->type = rec->type & ~TRACE_FOLD;
+	e->xany.display = X_Dpy;
+	replay_translate(e);
+	return 1;
+}
+
+static Bool
+replay_leftover(Display *dpy, XEvent *e, XPointer arg)
+{
+	return e->xany.serial == TRACE_SERIAL;
+}
+
+/*
+ * Feed a trace through the event handlers as fast as possible.
+ * Events that were folded while recording are put back on the queue
+ * in front of the handler, so that it folds them again.
+ */
+void
+xev_replay(const char *path)
+{
+	FILE			*fp;
+	struct trace_hdr	 hdr;
+	struct trace_rec	 rec, next;
+	struct replay_map	*m;
+	XEvent			 e, ne, left, fold[TRACE_NFOLD];
+	unsigned long long	 start, usec;
+	unsigned long		 nevents = 0;
+	size_t			 i;
+	int			 more, nfold;
+
+	if ((fp = fopen(path, "r")) == NULL)
+		err(1, "%s", path);
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    (hdr.version != 1 && hdr.version != TRACE_VERSION))
+		errx(1, "%s: not an event trace", path);
+	if (hdr.version >= 2 && hdr.root != None)
+		replay_add(hdr.root, DefaultRootWindow(X_Dpy), STANDIN_NONE);
+
+	start = u_time_usec();
+	more = replay_read(fp, &next, &ne, path);
+	while (more) {
+		rec = next;
+		e = ne;
+		more = replay_read(fp, &next, &ne, path);
+		if (rec.type == TRACE_FLUSH) {
+			layout_flush();
+			timer_run();
+			continue;
+		}
+		for (nfold = 0; more && (next.type & TRACE_FOLD);
+		    more = replay_read(fp, &next, &ne, path)) {
+			if (nfold < TRACE_NFOLD)
+				fold[nfold++] = ne;
+		}
+		/* XPutBackEvent puts in front, so go from the last. */
+		while (nfold > 0) {
+			fold[--nfold].xany.serial = TRACE_SERIAL;
+			XPutBackEvent(X_Dpy, &fold[nfold]);
+		}
+		xev_handle(&e);
+		nevents++;
+		while (XCheckIfEvent(X_Dpy, &left, replay_leftover, NULL))
+			;
+
+		if (e.type == DestroyNotify) {
+			/* The stand-in has served its purpose. */
+			for (i = 0; i < rmapsz; i++) {
+				m = &rmap[i];
+				if (m->from != None &&
+				    m->standin == STANDIN_LIVE &&
+				    m->to == e.xdestroywindow.window) {
+					XDestroyWindow(X_Dpy, m->to);
+					m->standin = STANDIN_GONE;
+					break;
+				}
+			}
+		}
+	}
+	layout_flush();
+	xu_sync(False);
+	usec = u_time_usec() - start;
+	fclose(fp);
+
+	fprintf(stderr, "replay: %lu events in %llu usec\n", nevents, usec);
+}
@@ -31,6 +31,11 @@
 
 #include "calmwm.h"
 
+/* Usec to wait for more changes before publishing the client lists. */
+#define CLIENTLIST_DELAY	10000
+
+static void	 xu_ewmh_net_client_lists(void *);
+
 void
 xu_ptr_get(Window win, int *x, int *y)
 {
@@ -47,6 +52,14 @@ xu_ptr_set(Window win, int x, int y)
 	XWarpPointer(X_Dpy, None, win, 0, 0, 0, 0, x, y);
 }
 
+/* XSync, counted: each one is a round trip to the server. */
+void
+xu_sync(Bool discard)
+{
+	Stats.xsync++;
+	XSync(X_Dpy, discard);
+}
+
 int
 xu_get_prop(Window win, Atom atm, Atom type, long len, unsigned char **p)
 {
@@ -247,7 +260,7 @@ xu_ewmh_net_workarea(struct screen_ctx *sc)
 	XChangeProperty(X_Dpy, sc->rootwin, ewmh[_NET_WORKAREA],
 	    XA_CARDINAL, 32, PropModeReplace, (unsigned char *)workarea,
 	    ngroups * 4);
-	free(workarea);
+	xfree(workarea);
 }
 
 void
@@ -267,7 +280,7 @@ xu_ewmh_net_client_list(struct screen_ctx *sc)
 		winlist[j++] = cc->win;
 	XChangeProperty(X_Dpy, sc->rootwin, ewmh[_NET_CLIENT_LIST],
 	    XA_WINDOW, 32, PropModeReplace, (unsigned char *)winlist, i);
-	free(winlist);
+	xfree(winlist);
 }
 
 void
@@ -288,7 +301,25 @@ xu_ewmh_net_client_list_stacking(struct screen_ctx *sc)
 		winlist[--j] = cc->win;
 	XChangeProperty(X_Dpy, sc->rootwin, ewmh[_NET_CLIENT_LIST_STACKING],
 	    XA_WINDOW, 32, PropModeReplace, (unsigned char *)winlist, i);
-	free(winlist);
+	xfree(winlist);
+}
+
+static void
+xu_ewmh_net_client_lists(void *arg)
+{
+	struct screen_ctx	*sc = arg;
+
+	xu_ewmh_net_client_list(sc);
+	xu_ewmh_net_client_list_stacking(sc);
+}
+
+/* Publish both client lists once a burst of changes is over. */
+void
+xu_ewmh_net_client_lists_defer(struct screen_ctx *sc)
+{
+	timer_del(&sc->clientlist);
+	timer_add(&sc->clientlist, CLIENTLIST_DELAY,
+	    xu_ewmh_net_client_lists, sc);
 }
 
 void
@@ -296,6 +327,8 @@ xu_ewmh_net_active_window(struct screen_ctx *sc, Window w)
 {
 	XChangeProperty(X_Dpy, sc->rootwin, ewmh[_NET_ACTIVE_WINDOW],
 	    XA_WINDOW, 32, PropModeReplace, (unsigned char *)&w, 1);
+	ctl_event("focus 0x%lx", w);
+	shm_active(w);
 }
 
 void
@@ -360,7 +393,7 @@ xu_ewmh_net_desktop_names(struct screen_ctx *sc)
 	while (n < nstrings) {
 		TAILQ_FOREACH(gc, &sc->groupq, entry) {
 			if (gc->num == n) {
-				free(gc->name);
+				xfree(gc->name);
 				gc->name = xstrdup(p);
 				p += strlen(p) + 1;
 				break;
@@ -385,7 +418,9 @@ xu_ewmh_net_desktop_names(struct screen_ctx *sc)
 
 	XChangeProperty(X_Dpy, sc->rootwin, ewmh[_NET_DESKTOP_NAMES],
 	    cwmh[UTF8_STRING], 8, PropModeReplace, (unsigned char *)p, len);
-	free(p);
+	xfree(p);
+
+	shm_groups(sc);
 }
 
 /* Application Window Properties */
@@ -488,6 +523,36 @@ xu_ewmh_handle_net_wm_state_msg(struct client_ctx *cc, int action,
 	}
 }
 
+static int
+xu_ewmh_is_net_wm_state(Atom atom)
+{
+	int	 i;
+
+	for (i = _NET_WM_STATE + 1; i <= _NET_WM_STATE + _NET_WM_STATES_NITEMS;
+	    i++) {
+		if (atom == ewmh[i])
+			return 1;
+	}
+	return 0;
+}
+
+static void
+xu_ewmh_save_net_wm_state(struct client_ctx *cc, Atom *atoms, int n)
+{
+	int	 i;
+
+	xfree(cc->fstate);
+	cc->fstate = NULL;
+	cc->nfstate = 0;
+	for (i = 0; i < n; i++) {
+		if (xu_ewmh_is_net_wm_state(atoms[i]))
+			continue;
+		cc->fstate = xreallocarray(cc->fstate, cc->nfstate + 1,
+		    sizeof(Atom));
+		cc->fstate[cc->nfstate++] = atoms[i];
+	}
+}
+
 void
 xu_ewmh_restore_net_wm_state(struct client_ctx *cc)
 {
@@ -495,6 +560,7 @@ xu_ewmh_restore_net_wm_state(struct client_ctx *cc)
 	int	 i, n;
 
 	atoms = xu_ewmh_get_net_wm_state(cc, &n);
+	xu_ewmh_save_net_wm_state(cc, atoms, n);
 	for (i = 0; i < n; i++) {
 		if (atoms[i] == ewmh[_NET_WM_STATE_STICKY])
 			client_toggle_sticky(cc);
@@ -515,30 +581,34 @@ xu_ewmh_restore_net_wm_state(struct client_ctx *cc)
 		if (atoms[i] == ewmh[_CWM_WM_STATE_FREEZE])
 			client_toggle_freeze(cc);
 	}
-	free(atoms);
+	xfree(atoms);
+}
+
+/*
+ * Somebody else changed _NET_WM_STATE; refresh our copy of the atoms
+ * we don't manage so that later writes can preserve them.
+ */
+void
+xu_ewmh_update_net_wm_state(struct client_ctx *cc)
+{
+	Atom	*atoms;
+	int	 n;
+
+	atoms = xu_ewmh_get_net_wm_state(cc, &n);
+	xu_ewmh_save_net_wm_state(cc, atoms, n);
+	xfree(atoms);
 }
 
 void
 xu_ewmh_set_net_wm_state(struct client_ctx *cc)
 {
-	Atom	*atoms, *oatoms;
-	int	 n, i, j;
-
-	oatoms = xu_ewmh_get_net_wm_state(cc, &n);
-	atoms = xreallocarray(NULL, (n + _NET_WM_STATES_NITEMS), sizeof(Atom));
-	for (i = j = 0; i < n; i++) {
-		if (oatoms[i] != ewmh[_NET_WM_STATE_STICKY] &&
-		    oatoms[i] != ewmh[_NET_WM_STATE_MAXIMIZED_VERT] &&
-		    oatoms[i] != ewmh[_NET_WM_STATE_MAXIMIZED_HORZ] &&
-		    oatoms[i] != ewmh[_NET_WM_STATE_HIDDEN] &&
-		    oatoms[i] != ewmh[_NET_WM_STATE_FULLSCREEN] &&
-		    oatoms[i] != ewmh[_NET_WM_STATE_DEMANDS_ATTENTION] &&
-		    oatoms[i] != ewmh[_NET_WM_STATE_SKIP_PAGER] &&
-		    oatoms[i] != ewmh[_NET_WM_STATE_SKIP_TASKBAR] &&
-		    oatoms[i] != ewmh[_CWM_WM_STATE_FREEZE])
-			atoms[j++] = oatoms[i];
-	}
-	free(oatoms);
+	Atom	*atoms;
+	int	 i, j;
+
+	atoms = xreallocarray(NULL, (cc->nfstate + _NET_WM_STATES_NITEMS),
+	    sizeof(Atom));
+	for (i = j = 0; i < cc->nfstate; i++)
+		atoms[j++] = cc->fstate[i];
 	if (cc->flags & CLIENT_STICKY)
 		atoms[j++] = ewmh[_NET_WM_STATE_STICKY];
 	if (cc->flags & CLIENT_HIDDEN)
@@ -559,10 +629,12 @@ xu_ewmh_set_net_wm_state(struct client_ctx *cc)
 		atoms[j++] = ewmh[_NET_WM_STATE_SKIP_TASKBAR];
 	if (cc->flags & CLIENT_FREEZE)
 		atoms[j++] = ewmh[_CWM_WM_STATE_FREEZE];
-	if (j > 0)
-		XChangeProperty(X_Dpy, cc->win, ewmh[_NET_WM_STATE],
-		    XA_ATOM, 32, PropModeReplace, (unsigned char *)atoms, j);
-	else
-		XDeleteProperty(X_Dpy, cc->win, ewmh[_NET_WM_STATE]);
-	free(atoms);
+	/*
+	 * Always replace, even with an empty list, so every write yields
+	 * exactly one PropertyNotify to account for in fstate_pending.
+	 */
+	XChangeProperty(X_Dpy, cc->win, ewmh[_NET_WM_STATE],
+	    XA_ATOM, 32, PropModeReplace, (unsigned char *)atoms, j);
+	cc->fstate_pending++;
+	xfree(atoms);
 }